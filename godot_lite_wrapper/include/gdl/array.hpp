@@ -0,0 +1,52 @@
+#ifndef GDL_ARRAY_HPP
+#define GDL_ARRAY_HPP
+
+#include "api.hpp"
+#include "lifetime.hpp"
+#include "variant.hpp"
+
+namespace gdl {
+
+template<>
+struct native_handle_funcs<godot_array> {
+    static godot_array new_default()
+    {
+        godot_array ret;
+        api->godot_array_new(&ret);
+        return ret;
+    }
+
+    static godot_array new_copy(godot_array array)
+    {
+        godot_array ret;
+        api->godot_array_new_copy(&ret, &array);
+        return ret;
+    }
+
+    static void destroy(godot_array array)
+    {
+        api->godot_array_destroy(&array);
+    }
+};
+
+class array : public lifetime<godot_array>
+{
+public:
+    using lifetime::lifetime;
+
+    void append(variant const& value)
+    {
+        api->godot_array_append(&m_native_handle, value.get());
+    }
+};
+
+inline godot_variant to_variant_handle(array const& a)
+{
+    godot_variant ret;
+    api->godot_variant_new_array(&ret, a.get());
+    return ret;
+}
+
+} // gdl::
+
+#endif // header guard
@@ -32,6 +32,8 @@ struct native_handle_funcs<godot_dictionary> {
 class dictionary : public lifetime<godot_dictionary>
 {
 public:
+    using lifetime::lifetime;
+
     void set(variant const& key, variant const& value)
     {
         api->godot_dictionary_set(&m_native_handle, key.get(), value.get());
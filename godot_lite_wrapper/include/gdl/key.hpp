@@ -0,0 +1,75 @@
+#ifndef GDL_KEY_HPP
+#define GDL_KEY_HPP
+
+#include "string.hpp"
+#include "variant.hpp"
+
+namespace gdl {
+
+class key;
+
+namespace detail {
+inline key* first_key = nullptr;
+} // detail::
+
+// A string variant for dictionary keys and names passed to calls, made once
+// instead of every time it's used.  The string itself is kept too, for the
+// calls that take a method name as a godot_string.  Keys have to be globals:
+// they're created by initialise and destroyed by deinitialise, Godot strings
+// can't outlive the API.
+class key {
+public:
+    explicit key(char const* const n) noexcept
+        : name{n}
+        , next{detail::first_key}
+    {
+        detail::first_key = this;
+    }
+
+    key(key const&) = delete;
+    key& operator=(key const&) = delete;
+
+    operator variant const&() const noexcept
+    {
+        return value;
+    }
+
+    godot_variant const* get() const noexcept
+    {
+        return value.get();
+    }
+
+    godot_string const* text() const noexcept
+    {
+        return interned.get();
+    }
+
+    friend void intern_keys();
+    friend void release_keys() noexcept;
+
+private:
+    char const* name;
+    key* next;
+    string interned{null_handle};
+    variant value{null_handle};
+};
+
+inline void intern_keys()
+{
+    for (auto k = detail::first_key; k; k = k->next) {
+        k->interned = string{k->name};
+        k->value = k->interned;
+    }
+}
+
+inline void release_keys() noexcept
+{
+    for (auto k = detail::first_key; k; k = k->next) {
+        k->value.reset();
+        k->interned.reset();
+    }
+}
+
+} // gdl::
+
+#endif // header guard
@@ -1,62 +1,104 @@
 #ifndef GDL_LIFETIME_HPP
 #define GDL_LIFETIME_HPP
 
+#include <utility>
+
 namespace gdl {
 
 template<class T>
 struct native_handle_funcs;
 
+// Tag for a lifetime that doesn't hold a native object yet.
+struct null_handle_t {
+    explicit null_handle_t() = default;
+};
+
+inline constexpr null_handle_t null_handle{};
+
+// Owns a native Godot object.  Moving and releasing don't create a
+// replacement object, the source is left without one and may only be assigned
+// to or destroyed afterwards.
 template<class T>
 class lifetime {
 protected:
     T m_native_handle;
+    bool m_owned;
     using funcs = native_handle_funcs<T>;
 
 public:
     lifetime()
         : m_native_handle{funcs::new_default()}
+        , m_owned{true}
     {
     }
 
     lifetime(T native_handle)
         : m_native_handle{native_handle}
+        , m_owned{true}
+    {
+    }
+
+    explicit lifetime(null_handle_t) noexcept
+        : m_native_handle{}
+        , m_owned{false}
     {
     }
 
     lifetime(lifetime const& other)
-        : lifetime(funcs::new_copy(other.m_native_handle))
+        : m_native_handle{}
+        , m_owned{other.m_owned}
     {
+        if (m_owned)
+            m_native_handle = funcs::new_copy(other.m_native_handle);
     }
 
-    lifetime(lifetime&& other)
-        : lifetime(other.release())
+    lifetime(lifetime&& other) noexcept
+        : m_native_handle{other.m_native_handle}
+        , m_owned{std::exchange(other.m_owned, false)}
     {
     }
 
     lifetime& operator=(lifetime const& other)
     {
         auto copy = other;
-        std::swap(m_native_handle, copy.m_native_handle);
-        return *this;
+        return *this = std::move(copy);
     }
 
-    lifetime& operator=(lifetime&& other)
+    lifetime& operator=(lifetime&& other) noexcept
     {
-        std::swap(m_native_handle, other.m_native_handle);
-        other = lifetime{};
+        if (this != &other) {
+            reset();
+            m_native_handle = other.m_native_handle;
+            m_owned = std::exchange(other.m_owned, false);
+        }
+
         return *this;
     }
 
     ~lifetime()
     {
-        funcs::destroy(m_native_handle);
+        reset();
+    }
+
+    // Hands the native object over to the caller.
+    T release() noexcept
+    {
+        m_owned = false;
+        return m_native_handle;
+    }
+
+    // Destroys the native object now instead of at the end of the scope.
+    void reset() noexcept
+    {
+        if (m_owned)
+            funcs::destroy(m_native_handle);
+
+        m_owned = false;
     }
 
-    T release()
+    bool owned() const noexcept
     {
-        auto const ret = m_native_handle;
-        m_native_handle = funcs::new_default();
-        return ret;
+        return m_owned;
     }
 
     T* get() noexcept
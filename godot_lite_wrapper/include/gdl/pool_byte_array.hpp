@@ -0,0 +1,82 @@
+#ifndef GDL_POOL_BYTE_ARRAY_HPP
+#define GDL_POOL_BYTE_ARRAY_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "api.hpp"
+#include "lifetime.hpp"
+
+namespace gdl {
+
+template<>
+struct native_handle_funcs<godot_pool_byte_array> {
+    static godot_pool_byte_array new_default()
+    {
+        godot_pool_byte_array ret;
+        api->godot_pool_byte_array_new(&ret);
+        return ret;
+    }
+
+    static godot_pool_byte_array new_copy(godot_pool_byte_array array)
+    {
+        godot_pool_byte_array ret;
+        api->godot_pool_byte_array_new_copy(&ret, &array);
+        return ret;
+    }
+
+    static void destroy(godot_pool_byte_array array)
+    {
+        api->godot_pool_byte_array_destroy(&array);
+    }
+};
+
+class pool_byte_array : public lifetime<godot_pool_byte_array>
+{
+public:
+    using lifetime::lifetime;
+
+    void resize(int size)
+    {
+        api->godot_pool_byte_array_resize(&m_native_handle, size);
+    }
+
+    int size() const
+    {
+        return api->godot_pool_byte_array_size(&m_native_handle);
+    }
+
+    void assign(char const* const data, int const size)
+    {
+        resize(size);
+
+        auto const access = api->godot_pool_byte_array_write(&m_native_handle);
+        auto const ptr = api->godot_pool_byte_array_write_access_ptr(access);
+        std::copy_n(reinterpret_cast<std::uint8_t const*>(data), size, ptr);
+        api->godot_pool_byte_array_write_access_destroy(access);
+    }
+
+    std::vector<char> contents() const
+    {
+        std::vector<char> ret(size());
+
+        auto const access = api->godot_pool_byte_array_read(&m_native_handle);
+        auto const ptr = api->godot_pool_byte_array_read_access_ptr(access);
+        std::copy_n(reinterpret_cast<char const*>(ptr), ret.size(), ret.data());
+        api->godot_pool_byte_array_read_access_destroy(access);
+
+        return ret;
+    }
+};
+
+inline godot_variant to_variant_handle(pool_byte_array const& arr)
+{
+    godot_variant ret;
+    api->godot_variant_new_pool_byte_array(&ret, arr.get());
+    return ret;
+}
+
+} // gdl::
+
+#endif // header guard
@@ -0,0 +1,76 @@
+#ifndef GDL_POOL_COLOR_ARRAY_HPP
+#define GDL_POOL_COLOR_ARRAY_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "api.hpp"
+#include "lifetime.hpp"
+
+namespace gdl {
+
+template<>
+struct native_handle_funcs<godot_pool_color_array> {
+    static godot_pool_color_array new_default()
+    {
+        godot_pool_color_array ret;
+        api->godot_pool_color_array_new(&ret);
+        return ret;
+    }
+
+    static godot_pool_color_array new_copy(godot_pool_color_array array)
+    {
+        godot_pool_color_array ret;
+        api->godot_pool_color_array_new_copy(&ret, &array);
+        return ret;
+    }
+
+    static void destroy(godot_pool_color_array array)
+    {
+        api->godot_pool_color_array_destroy(&array);
+    }
+};
+
+class pool_color_array : public lifetime<godot_pool_color_array>
+{
+public:
+    using lifetime::lifetime;
+
+    void resize(int size)
+    {
+        api->godot_pool_color_array_resize(&m_native_handle, size);
+    }
+
+    int size() const
+    {
+        return api->godot_pool_color_array_size(&m_native_handle);
+    }
+
+    void set(int index, godot_color const& value)
+    {
+        api->godot_pool_color_array_set(&m_native_handle, index, value);
+    }
+
+    std::vector<godot_color> contents() const
+    {
+        std::vector<godot_color> ret(size());
+
+        auto const access = api->godot_pool_color_array_read(&m_native_handle);
+        auto const ptr = api->godot_pool_color_array_read_access_ptr(access);
+        std::copy_n(ptr, ret.size(), ret.data());
+        api->godot_pool_color_array_read_access_destroy(access);
+
+        return ret;
+    }
+};
+
+inline godot_variant to_variant_handle(pool_color_array const& arr)
+{
+    godot_variant ret;
+    api->godot_variant_new_pool_color_array(&ret, arr.get());
+    return ret;
+}
+
+} // gdl::
+
+#endif // header guard
@@ -31,6 +31,8 @@ struct native_handle_funcs<godot_pool_int_array> {
 class pool_int_array : public lifetime<godot_pool_int_array>
 {
 public:
+    using lifetime::lifetime;
+
     void resize(int size)
     {
         api->godot_pool_int_array_resize(&m_native_handle, size);
@@ -42,7 +44,7 @@ public:
     }
 };
 
-godot_variant to_variant_handle(pool_int_array const& arr)
+inline godot_variant to_variant_handle(pool_int_array const& arr)
 {
     godot_variant ret;
     api->godot_variant_new_pool_int_array(&ret, arr.get());
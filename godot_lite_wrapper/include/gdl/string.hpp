@@ -1,6 +1,9 @@
 #ifndef GDL_STRING_HPP
 #define GDL_STRING_HPP
 
+#include <stdexcept>
+#include <string>
+
 #include "api.hpp"
 #include "lifetime.hpp"
 #include "variant.hpp"
@@ -45,6 +48,8 @@ class string : public lifetime<godot_string>
     }
 
 public:
+    using lifetime::lifetime;
+
     string() = default;
     string(wchar_t const* const content, int const size)
         : lifetime{from_wide_string(content, size)}
@@ -60,6 +65,17 @@ public:
         : lifetime{api->godot_string_chars_to_utf8(content)}
     {
     }
+
+    std::string utf8() const
+    {
+        auto chars = api->godot_string_utf8(&m_native_handle);
+        auto ret = std::string{
+            api->godot_char_string_get_data(&chars),
+            static_cast<std::size_t>(api->godot_char_string_length(&chars))};
+
+        api->godot_char_string_destroy(&chars);
+        return ret;
+    }
 };
 
 inline godot_variant to_variant_handle(string const& d)
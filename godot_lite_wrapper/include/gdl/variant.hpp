@@ -1,7 +1,9 @@
 #ifndef GDL_VARIANT_HPP
 #define GDL_VARIANT_HPP
 
+#include <concepts>
 #include <cstdint>
+#include <type_traits>
 #include <utility>
 
 #include "api.hpp"
@@ -45,6 +47,30 @@ inline godot_variant to_variant_handle(std::int64_t v)
     return ret;
 }
 
+inline godot_variant to_variant_handle(double v)
+{
+    godot_variant ret;
+    api->godot_variant_new_real(&ret, v);
+    return ret;
+}
+
+// Godot's arrays, dictionaries and strings are reference counted, so a
+// variant made from one shares its data.  When the object is a temporary its
+// reference is dropped right away.  That leaves the variant as the only owner
+// and nothing gets copied when the receiver writes to it.
+template<class L>
+    requires (!std::is_lvalue_reference_v<L>)
+          && requires(L& l) {
+                 { to_variant_handle(std::as_const(l)) } -> std::same_as<godot_variant>;
+                 l.reset();
+             }
+godot_variant to_variant_handle(L&& l)
+{
+    auto const ret = to_variant_handle(std::as_const(l));
+    l.reset();
+    return ret;
+}
+
 template<class T>
 concept fits_in_variant = requires(T a) {
     { to_variant_handle(std::move(a)) } -> std::convertible_to<godot_variant>;
@@ -54,6 +80,11 @@ class variant : public lifetime<godot_variant> {
 public:
     variant() = default;
 
+    explicit variant(null_handle_t) noexcept
+        : lifetime{null_handle}
+    {
+    }
+
     template<fits_in_variant F>
     variant(F&& item)
         : lifetime{to_variant_handle(std::forward<F>(item))}
@@ -66,6 +97,6 @@ public:
     }
 };
 
-}
+} // gdl::
 
 #endif // header guard
@@ -1,6 +1,7 @@
 #include <algorithm>
 
 #include <gdl/api.hpp>
+#include <gdl/key.hpp>
 
 namespace gdl {
 
@@ -25,10 +26,14 @@ void initialise(godot_gdnative_init_options* options)
     api = options->api_struct;
     nativescript_api = reinterpret_cast<decltype(nativescript_api)>(
                             find_extension_of_type(GDNATIVE_EXT_NATIVESCRIPT));
+
+    intern_keys();
 }
 
 void deinitialise()
 {
+    release_keys();
+
     nativescript_api = nullptr;
     api = nullptr;
 }
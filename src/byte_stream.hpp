@@ -0,0 +1,70 @@
+#ifndef GDTERM_BYTE_STREAM_HPP
+#define GDTERM_BYTE_STREAM_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace gd100 {
+
+// Appends trivially copyable values to a byte vector in native byte order.
+class writer {
+public:
+    explicit writer(std::vector<char>& o)
+        : out{o}
+    {
+    }
+
+    template<class T>
+    void put(T const value)
+    {
+        put_bytes(&value, sizeof(value));
+    }
+
+    void put_bytes(void const* const data, std::size_t const size)
+    {
+        auto const bytes = static_cast<char const*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    }
+
+private:
+    std::vector<char>& out;
+};
+
+// Reads values written by writer, every get fails once the data runs out.
+class reader {
+public:
+    reader(char const* const d, std::size_t const s)
+        : data{d}
+        , remaining{s}
+    {
+    }
+
+    template<class T>
+    bool get(T& value)
+    {
+        return get_bytes(&value, sizeof(value));
+    }
+
+    bool get_bytes(void* const dest, std::size_t const size)
+    {
+        if (size > remaining)
+            return false;
+
+        if (size == 0) // dest may be the data() of an empty vector
+            return true;
+
+        std::memcpy(dest, data, size);
+        data += size;
+        remaining -= size;
+        return true;
+    }
+
+private:
+    char const* data;
+    std::size_t remaining;
+};
+
+} // gd100::
+
+#endif // header guard
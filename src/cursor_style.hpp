@@ -0,0 +1,41 @@
+#ifndef GDTERM_CURSOR_STYLE_HPP
+#define GDTERM_CURSOR_STYLE_HPP
+
+#include <cstdint>
+
+#include <katerm/terminal.hpp>
+
+namespace gd100 {
+
+enum class cursor_shape : std::uint8_t {
+    block = 0,
+    underline = 1,
+    bar = 2,
+};
+
+// Set with DECSCUSR (CSI Ps SP q), DECTCEM (CSI ? 25 h/l) and the blink mode
+// (CSI ? 12 h/l).
+struct cursor_style {
+    cursor_shape shape = cursor_shape::block;
+    bool blinking = true;
+    bool visible = true;
+
+    friend bool operator==(cursor_style const& a, cursor_style const& b)
+    {
+        return a.shape == b.shape && a.blinking == b.blinking && a.visible == b.visible;
+    }
+};
+
+struct cursor_state {
+    katerm::position pos{};
+    cursor_style style;
+
+    friend bool operator==(cursor_state const& a, cursor_state const& b)
+    {
+        return a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.style == b.style;
+    }
+};
+
+} // gd100::
+
+#endif // header guard
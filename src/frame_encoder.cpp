@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <utility>
+
+#include "frame_encoder.hpp"
+#include "palette.hpp"
+#include "trace.hpp"
+#include "unicode_width.hpp"
+
+namespace gd100 {
+
+void frame_encoder::reset()
+{
+    width = 0;
+    height = 0;
+    sent_cursor.reset();
+    shadow.clear();
+}
+
+namespace {
+
+// Arrays per row in the shadow, each width entries long.
+constexpr int plane_count = 4;
+constexpr int code_plane = 0;
+constexpr int fg_plane = 1;
+constexpr int bg_plane = 2;
+constexpr int attr_plane = 3;
+
+// The glyph attributes that affect the encoded cell.
+constexpr std::uint32_t attr_reversed = 1;
+constexpr std::uint32_t attr_wide_dummy = 2;
+
+// Colours come in runs, so remembering the last lookup avoids most searches
+// through the palette.
+class colour_resolver {
+public:
+    // Returns the palette index or colour and whether it's an index.
+    std::pair<std::int32_t, bool> resolve(std::uint32_t const rgba)
+    {
+        if (rgba != last_rgba) {
+            last_rgba = rgba;
+            last_index = ansi_palette_index(rgba);
+        }
+
+        if (last_index == -1)
+            return {static_cast<std::int32_t>(rgba), false};
+
+        return {last_index, true};
+    }
+
+private:
+    std::uint32_t last_rgba = default_palette[0];
+    int last_index = 0;
+};
+
+} // ::
+
+void frame_encoder::gather_row(
+        katerm::terminal const& term,
+        int const row,
+        std::uint32_t* const planes) const
+{
+    auto const codes = planes + code_plane * width;
+    auto const fgs = planes + fg_plane * width;
+    auto const bgs = planes + bg_plane * width;
+    auto const attrs = planes + attr_plane * width;
+
+    for (int column = 0; column != width; ++column) {
+        auto const glyph = term.screen.get_glyph({column, row});
+
+        codes[column] = glyph.code;
+        fgs[column] = to_u32(glyph.style.fg);
+        bgs[column] = to_u32(glyph.style.bg);
+        attrs[column] =
+            (glyph.style.mode.is_set(katerm::glyph_attr_bit::reversed) ? attr_reversed : 0)
+            | (glyph.style.mode.is_set(katerm::glyph_attr_bit::wide_dummy) ? attr_wide_dummy : 0);
+    }
+}
+
+void frame_encoder::encode_planes(std::uint32_t const* const planes, std::int32_t* const out) const
+{
+    auto const codes = planes + code_plane * width;
+    auto const fgs = planes + fg_plane * width;
+    auto const bgs = planes + bg_plane * width;
+    auto const attrs = planes + attr_plane * width;
+
+    colour_resolver fg_resolver;
+    colour_resolver bg_resolver;
+
+    for (int column = 0; column != width; ++column) {
+        auto fg = fg_resolver.resolve(fgs[column]);
+        auto bg = bg_resolver.resolve(bgs[column]);
+
+        if (attrs[column] & attr_reversed)
+            std::swap(fg, bg);
+
+        out[column * cell_stride + 0] = fg.first;
+        out[column * cell_stride + 1] = bg.first;
+        out[column * cell_stride + 2] = (fg.second ? cell_fg_indexed : 0)
+                                      | (bg.second ? cell_bg_indexed : 0);
+    }
+
+    for (int column = 0; column != width; ++column) {
+        auto const glyph_code = codes[column];
+        auto code = static_cast<std::int32_t>(glyph_code);
+
+        if (attrs[column] & attr_wide_dummy) {
+            code |= cell_wide_continuation;
+        } else if (glyph_code != 0) {
+            switch (code_point_width(glyph_code)) {
+                case 0: code |= cell_zero_width; break;
+                case 2: code |= cell_wide; break;
+            }
+        }
+
+        out[column * cell_stride + 2] |= code;
+    }
+}
+
+void frame_encoder::shift_shadow(region_shift const shift)
+{
+    auto const row_size = static_cast<std::ptrdiff_t>(width) * plane_count;
+    auto const region_begin = shadow.begin() + shift.top * row_size;
+    auto const region_end = shadow.begin() + shift.bottom * row_size;
+
+    // The rows that are exposed keep their old content, it's up to the
+    // comparison in encode to notice they differ.
+    if (shift.delta > 0)
+        std::copy(region_begin + shift.delta * row_size, region_end, region_begin);
+    else
+        std::copy_backward(region_begin, region_end + shift.delta * row_size, region_end);
+}
+
+frame frame_encoder::encode(katerm::terminal const& term, cursor_style const& style)
+{
+    auto const span = trace_span{"encode"};
+    auto const size = term.screen.size();
+
+    frame ret;
+    ret.width = size.width;
+    ret.scroll_change = term.screen.changed_scroll();
+    ret.mouse = term.mouse;
+    ret.sgr_mouse = term.mode.is_set(katerm::terminal_mode_bit::extended_mouse);
+
+    auto const cursor = cursor_state{term.cursor.pos, style};
+    if (cursor != sent_cursor) {
+        ret.cursor = cursor;
+        sent_cursor = cursor;
+    }
+
+    auto const full_update = size.width != width || size.height != height;
+
+    ret.mouse_changed = full_update || ret.mouse != sent_mouse || ret.sgr_mouse != sent_sgr_mouse;
+    sent_mouse = ret.mouse;
+    sent_sgr_mouse = ret.sgr_mouse;
+
+    if (full_update) {
+        width = size.width;
+        height = size.height;
+        shadow.assign(static_cast<std::size_t>(width) * height * plane_count, 0);
+    }
+
+    // katerm marks every line that moved as changed, so with a shift every
+    // row of the region is compared against the shifted copy.  Without one
+    // only the changed lines can differ from what was sent before.
+    auto const shifted = !full_update
+                         && ret.scroll_change != 0
+                         && std::abs(ret.scroll_change) < height;
+
+    if (shifted) {
+        ret.shift = region_shift{0, height, ret.scroll_change};
+        shift_shadow(*ret.shift);
+    }
+
+    auto const row_size = static_cast<std::size_t>(width) * plane_count;
+    auto const cells_per_row = static_cast<std::size_t>(width) * cell_stride;
+    scratch.resize(row_size);
+
+    for (int row = 0; row != height; ++row) {
+        if (!full_update && !shifted && !term.screen.lines[row].changed)
+            continue;
+
+        gather_row(term, row, scratch.data());
+
+        auto const shadow_row = shadow.data() + row * row_size;
+        if (!full_update
+            && std::memcmp(shadow_row, scratch.data(), row_size * sizeof(std::uint32_t)) == 0)
+            continue;
+
+        std::copy(scratch.begin(), scratch.end(), shadow_row);
+        ret.rows.push_back(row);
+
+        ret.cells.resize(ret.cells.size() + cells_per_row);
+        encode_planes(scratch.data(), ret.cells.data() + ret.cells.size() - cells_per_row);
+    }
+
+    return ret;
+}
+
+} // gd100::
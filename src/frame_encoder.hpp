@@ -0,0 +1,121 @@
+#ifndef GDTERM_FRAME_ENCODER_HPP
+#define GDTERM_FRAME_ENCODER_HPP
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <katerm/terminal.hpp>
+
+#include "cursor_style.hpp"
+#include "image.hpp"
+
+namespace gd100 {
+
+// Number of integers used per cell: foreground, background and code point.
+constexpr int cell_stride = 3;
+
+// Set in the code point integer when the foreground or background is an index
+// into the terminal's palette rather than an 0xRRGGBBAA colour, so that the
+// receiver can switch themes without getting every line again.  Only the 16
+// system colours are sent as indices, see ansi_palette_index.
+constexpr std::int32_t cell_fg_indexed = 1 << 24;
+constexpr std::int32_t cell_bg_indexed = 1 << 25;
+
+// Display width of the cell, also in the code point integer.  A wide
+// character covers its own cell and the continuation cell after it, a zero
+// width one (a combining mark) is drawn on top of the cell before it.
+constexpr std::int32_t cell_wide = 1 << 26;
+constexpr std::int32_t cell_wide_continuation = 1 << 27;
+constexpr std::int32_t cell_zero_width = 1 << 28;
+
+// Mask to get the code point itself.
+constexpr std::int32_t cell_code_mask = 0x1fffff;
+
+// Rows [top, bottom) moved up by delta rows (down when delta is negative).
+// The receiver applies this to what it has on screen before updating any of
+// the lines in the frame.
+struct region_shift {
+    int top;
+    int bottom;
+    int delta;
+};
+
+// A screen update, independent of how it's delivered to the renderer.
+struct frame {
+    int width = 0;
+
+    std::optional<region_shift> shift;
+
+    // Rows that need to be redrawn; the cells of rows[i] are stored at
+    // cells[i * width * cell_stride].
+    std::vector<std::int32_t> rows;
+    std::vector<std::int32_t> cells;
+
+    // Only set when the cursor moved or changed style since the previous
+    // frame.
+    std::optional<cursor_state> cursor;
+    int scroll_change = 0;
+
+    // Needed by the receiver to report mouse events the way the program
+    // asked for them.
+    katerm::mouse_mode mouse = katerm::mouse_mode::none;
+    bool sgr_mouse = false;
+
+    // Whether mouse or sgr_mouse differ from the previous frame.  Not
+    // transferred by write_frame.
+    bool mouse_changed = false;
+
+    // Filled in by graphics_filter rather than the encoder.  The receiver
+    // removes the deleted images first (id 0 means all of them), then shows
+    // the new placements.
+    std::vector<image_placement> images;
+    std::vector<std::uint32_t> deleted_images;
+
+    std::int32_t const* row_cells(std::size_t const index) const
+    {
+        return cells.data() + index * width * cell_stride;
+    }
+
+    // Nothing the receiver has to act on, no need to deliver it.
+    bool empty() const noexcept
+    {
+        return !shift && rows.empty() && !cursor && scroll_change == 0 && !mouse_changed
+            && images.empty() && deleted_images.empty();
+    }
+};
+
+// Creates frames from a terminal.  Keeps a copy of what the receiver has on
+// screen so that lines which only moved because of scrolling aren't sent
+// again.
+//
+// The copy holds the glyph fields that end up in a frame, stored per row as
+// separate code, foreground, background and attribute arrays with all rows
+// in one allocation.  A row is read from the terminal once into the same
+// layout and compared with a single memcmp, only rows that differ are
+// turned into frame cells.
+class frame_encoder {
+public:
+    // The cursor style comes from tracking_decoder::cursor.
+    frame encode(katerm::terminal const& term, cursor_style const& style);
+
+    // Forget what was sent, the next frame will contain every line.
+    void reset();
+
+private:
+    void shift_shadow(region_shift shift);
+    void gather_row(katerm::terminal const& term, int row, std::uint32_t* planes) const;
+    void encode_planes(std::uint32_t const* planes, std::int32_t* out) const;
+
+    int width = 0;
+    int height = 0;
+    std::optional<cursor_state> sent_cursor;
+    katerm::mouse_mode sent_mouse = katerm::mouse_mode::none;
+    bool sent_sgr_mouse = false;
+    std::vector<std::uint32_t> shadow;
+    std::vector<std::uint32_t> scratch;
+};
+
+} // gd100::
+
+#endif // header guard
@@ -0,0 +1,147 @@
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "frame_ring.hpp"
+
+namespace gd100 {
+
+namespace {
+
+std::size_t round_up(std::size_t const value, std::size_t const multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+} // ::
+
+frame_ring::frame_ring(int const d, void* const m, std::size_t const s)
+    : descriptor{d}
+    , mapping{m}
+    , mapping_size{s}
+{
+}
+
+frame_ring frame_ring::create(std::size_t const requested_capacity)
+{
+    auto const capacity = round_up(requested_capacity, alignment);
+    auto const size = sizeof(header) + capacity;
+
+    auto const fd = memfd_create("gd100-frame-ring", MFD_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error{"Couldn't create frame ring memfd."};
+
+    if (ftruncate(fd, size)) {
+        close(fd);
+        throw std::runtime_error{"Couldn't size frame ring memfd."};
+    }
+
+    auto const mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error{"Couldn't map frame ring."};
+    }
+
+    auto const h = new (mapping) header{};
+    h->capacity = capacity;
+
+    return frame_ring{fd, mapping, size};
+}
+
+frame_ring frame_ring::attach(int const fd)
+{
+    header h;
+    if (pread(fd, &h.capacity, sizeof(h.capacity), offsetof(header, capacity)) != sizeof(h.capacity)) {
+        close(fd);
+        throw std::runtime_error{"Couldn't read frame ring header."};
+    }
+
+    auto const size = sizeof(header) + h.capacity;
+    auto const mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error{"Couldn't map frame ring."};
+    }
+
+    return frame_ring{fd, mapping, size};
+}
+
+frame_ring::frame_ring(frame_ring&& other) noexcept
+    : descriptor{std::exchange(other.descriptor, -1)}
+    , mapping{std::exchange(other.mapping, nullptr)}
+    , mapping_size{std::exchange(other.mapping_size, 0)}
+{
+}
+
+frame_ring& frame_ring::operator=(frame_ring&& other) noexcept
+{
+    std::swap(descriptor, other.descriptor);
+    std::swap(mapping, other.mapping);
+    std::swap(mapping_size, other.mapping_size);
+    return *this;
+}
+
+frame_ring::~frame_ring()
+{
+    if (mapping)
+        munmap(mapping, mapping_size);
+
+    if (descriptor >= 0)
+        close(descriptor);
+}
+
+char* frame_ring::data() const noexcept
+{
+    return static_cast<char*>(mapping) + sizeof(header);
+}
+
+std::size_t frame_ring::capacity() const noexcept
+{
+    return static_cast<header*>(mapping)->capacity;
+}
+
+std::atomic<std::uint64_t>& frame_ring::head() const noexcept
+{
+    return static_cast<header*>(mapping)->head;
+}
+
+std::atomic<std::uint64_t>& frame_ring::tail() const noexcept
+{
+    return static_cast<header*>(mapping)->tail;
+}
+
+bool frame_ring::push(record_kind const kind, void const* const payload, std::size_t const size)
+{
+    auto const record_size = round_up(sizeof(record_header) + size, alignment);
+
+    auto position = head().load(std::memory_order_relaxed);
+    auto const used = position - tail().load(std::memory_order_acquire);
+
+    // Records never wrap around, if it doesn't fit before the end of the
+    // buffer the rest of the buffer is skipped with a padding record.
+    auto const until_end = capacity() - position % capacity();
+    auto const padding = record_size > until_end ? until_end : 0;
+
+    if (used + padding + record_size > capacity())
+        return false;
+
+    if (padding) {
+        auto const pad = record_header{static_cast<std::uint32_t>(padding - sizeof(record_header)), 0};
+        std::memcpy(data() + position % capacity(), &pad, sizeof(pad));
+        position += padding;
+    }
+
+    auto const record = data() + position % capacity();
+    auto const rh = record_header{static_cast<std::uint32_t>(size), kind};
+    std::memcpy(record, &rh, sizeof(rh));
+    std::memcpy(record + sizeof(rh), payload, size);
+
+    head().store(position + record_size, std::memory_order_release);
+    return true;
+}
+
+} // gd100::
@@ -0,0 +1,102 @@
+#ifndef GDTERM_FRAME_RING_HPP
+#define GDTERM_FRAME_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace gd100 {
+
+// Single producer, single consumer queue of variable sized records in shared
+// memory.  The memory lives in a memfd so it can be handed to another
+// process.  Records are stored contiguously and can be read in place.
+//
+// The ring itself doesn't notify anybody, that's done separately (the
+// terminal host uses an eventfd for it).
+class frame_ring {
+public:
+    // Kind 0 is reserved for padding at the end of the buffer.
+    using record_kind = std::uint32_t;
+
+    // Creates a new ring, used by the producer.
+    static frame_ring create(std::size_t capacity);
+
+    // Maps a ring created in another process, used by the consumer.  Takes
+    // ownership of the descriptor.
+    static frame_ring attach(int memory_descriptor);
+
+    frame_ring(frame_ring&& other) noexcept;
+    frame_ring& operator=(frame_ring&& other) noexcept;
+    ~frame_ring();
+
+    int memory_descriptor() const noexcept { return descriptor; }
+
+    // Returns false when there's not enough room, the record is not
+    // written in that case.
+    bool push(record_kind kind, void const* data, std::size_t size);
+
+    // Calls f(kind, data, size) for every available record and returns the
+    // number of records consumed.  The data points into the shared memory
+    // and is only valid during the call.
+    template<class F>
+    std::size_t drain(F&& f);
+
+private:
+    struct header;
+    struct record_header {
+        std::uint32_t size;
+        record_kind kind;
+    };
+
+    static constexpr std::size_t alignment = alignof(std::uint64_t);
+
+    frame_ring(int descriptor, void* mapping, std::size_t mapping_size);
+
+    char* data() const noexcept;
+    std::size_t capacity() const noexcept;
+    std::atomic<std::uint64_t>& head() const noexcept;
+    std::atomic<std::uint64_t>& tail() const noexcept;
+
+    int descriptor = -1;
+    void* mapping = nullptr;
+    std::size_t mapping_size = 0;
+};
+
+struct frame_ring::header {
+    // Written by the producer.
+    alignas(64) std::atomic<std::uint64_t> head;
+
+    // Written by the consumer.
+    alignas(64) std::atomic<std::uint64_t> tail;
+
+    std::uint64_t capacity;
+};
+
+template<class F>
+std::size_t frame_ring::drain(F&& f)
+{
+    auto const end = head().load(std::memory_order_acquire);
+    auto position = tail().load(std::memory_order_relaxed);
+
+    std::size_t count = 0;
+    while (position != end) {
+        auto const record = data() + position % capacity();
+
+        record_header rh;
+        __builtin_memcpy(&rh, record, sizeof(rh));
+
+        if (rh.kind != 0) {
+            f(rh.kind, static_cast<void const*>(record + sizeof(rh)), std::size_t{rh.size});
+            ++count;
+        }
+
+        position += (sizeof(rh) + rh.size + alignment - 1) / alignment * alignment;
+        tail().store(position, std::memory_order_release);
+    }
+
+    return count;
+}
+
+} // gd100::
+
+#endif // header guard
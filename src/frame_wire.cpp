@@ -0,0 +1,186 @@
+#include <cstdint>
+
+#include "byte_stream.hpp"
+#include "frame_wire.hpp"
+
+namespace gd100 {
+
+void write_frame(frame const& f, std::vector<char>& out)
+{
+    writer w{out};
+
+    w.put<std::int32_t>(f.width);
+    w.put<std::int32_t>(f.scroll_change);
+    w.put<std::int32_t>(static_cast<std::int32_t>(f.mouse));
+    w.put<std::uint8_t>(f.sgr_mouse);
+
+    w.put<std::uint8_t>(f.cursor.has_value());
+    if (f.cursor) {
+        w.put<std::int32_t>(f.cursor->pos.x);
+        w.put<std::int32_t>(f.cursor->pos.y);
+        w.put<std::uint8_t>(static_cast<std::uint8_t>(f.cursor->style.shape));
+        w.put<std::uint8_t>(f.cursor->style.blinking);
+        w.put<std::uint8_t>(f.cursor->style.visible);
+    }
+
+    w.put<std::uint8_t>(f.shift.has_value());
+    if (f.shift) {
+        w.put<std::int32_t>(f.shift->top);
+        w.put<std::int32_t>(f.shift->bottom);
+        w.put<std::int32_t>(f.shift->delta);
+    }
+
+    w.put<std::uint32_t>(f.rows.size());
+    for (auto const row : f.rows)
+        w.put<std::int32_t>(row);
+
+    w.put_bytes(f.cells.data(), f.cells.size() * sizeof(std::int32_t));
+
+    w.put<std::uint32_t>(f.deleted_images.size());
+    for (auto const id : f.deleted_images)
+        w.put<std::uint32_t>(id);
+
+    w.put<std::uint32_t>(f.images.size());
+    for (auto const& placement : f.images) {
+        w.put<std::uint32_t>(placement.id);
+        w.put<std::int32_t>(placement.column);
+        w.put<std::int32_t>(placement.row);
+
+        w.put<std::uint8_t>(placement.data != nullptr);
+        if (placement.data) {
+            w.put<std::uint8_t>(static_cast<std::uint8_t>(placement.data->format));
+            w.put<std::int32_t>(placement.data->width);
+            w.put<std::int32_t>(placement.data->height);
+            w.put<std::uint32_t>(placement.data->data.size());
+            w.put_bytes(placement.data->data.data(), placement.data->data.size());
+        }
+    }
+}
+
+bool read_frame(char const* const data, std::size_t const size, frame& f)
+{
+    reader r{data, size};
+
+    std::int32_t width, scroll_change, mouse;
+    std::uint8_t sgr_mouse, has_cursor, has_shift;
+
+    if (!r.get(width) || !r.get(scroll_change) || !r.get(mouse) || !r.get(sgr_mouse)
+        || !r.get(has_cursor))
+        return false;
+
+    f.width = width;
+    f.scroll_change = scroll_change;
+    f.mouse = static_cast<katerm::mouse_mode>(mouse);
+    f.sgr_mouse = sgr_mouse;
+
+    f.cursor.reset();
+    if (has_cursor) {
+        cursor_state cursor;
+        std::uint8_t shape, blinking, visible;
+        if (!r.get(cursor.pos.x) || !r.get(cursor.pos.y)
+            || !r.get(shape) || !r.get(blinking) || !r.get(visible))
+            return false;
+
+        cursor.style = cursor_style{static_cast<cursor_shape>(shape), blinking != 0, visible != 0};
+        f.cursor = cursor;
+    }
+
+    if (!r.get(has_shift))
+        return false;
+
+    f.shift.reset();
+    if (has_shift) {
+        region_shift shift;
+        if (!r.get(shift.top) || !r.get(shift.bottom) || !r.get(shift.delta))
+            return false;
+
+        f.shift = shift;
+    }
+
+    std::uint32_t row_count;
+    if (!r.get(row_count))
+        return false;
+
+    f.rows.resize(row_count);
+    if (!r.get_bytes(f.rows.data(), row_count * sizeof(std::int32_t)))
+        return false;
+
+    f.cells.resize(std::size_t{row_count} * width * cell_stride);
+    if (!r.get_bytes(f.cells.data(), f.cells.size() * sizeof(std::int32_t)))
+        return false;
+
+    std::uint32_t deleted_count;
+    if (!r.get(deleted_count))
+        return false;
+
+    f.deleted_images.resize(deleted_count);
+    if (!r.get_bytes(f.deleted_images.data(), deleted_count * sizeof(std::uint32_t)))
+        return false;
+
+    std::uint32_t image_count;
+    if (!r.get(image_count))
+        return false;
+
+    f.images.clear();
+    for (std::uint32_t i = 0; i != image_count; ++i) {
+        image_placement placement;
+        std::uint8_t has_data;
+
+        if (!r.get(placement.id) || !r.get(placement.column) || !r.get(placement.row)
+            || !r.get(has_data))
+            return false;
+
+        if (has_data) {
+            auto img = std::make_shared<image>();
+            std::uint8_t format;
+            std::uint32_t data_size;
+
+            if (!r.get(format) || !r.get(img->width) || !r.get(img->height) || !r.get(data_size))
+                return false;
+
+            img->id = placement.id;
+            img->format = static_cast<image_format>(format);
+            img->data.resize(data_size);
+            if (!r.get_bytes(img->data.data(), data_size))
+                return false;
+
+            placement.data = std::move(img);
+        }
+
+        f.images.push_back(std::move(placement));
+    }
+
+    return true;
+}
+
+void write_exit(process_exit const& e, std::vector<char>& out)
+{
+    writer w{out};
+
+    w.put<std::int32_t>(e.code);
+    w.put<std::int64_t>(e.user_time.count());
+    w.put<std::int64_t>(e.system_time.count());
+    w.put<std::int64_t>(e.max_rss);
+}
+
+bool read_exit(char const* const data, std::size_t const size, process_exit& e)
+{
+    reader r{data, size};
+
+    std::int32_t code;
+    std::int64_t user_time, system_time, max_rss;
+
+    if (!r.get(code) || !r.get(user_time) || !r.get(system_time) || !r.get(max_rss))
+        return false;
+
+    e = process_exit{
+        code,
+        std::chrono::microseconds{user_time},
+        std::chrono::microseconds{system_time},
+        static_cast<long>(max_rss),
+    };
+
+    return true;
+}
+
+} // gd100::
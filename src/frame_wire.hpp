@@ -0,0 +1,24 @@
+#ifndef GDTERM_FRAME_WIRE_HPP
+#define GDTERM_FRAME_WIRE_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "frame_encoder.hpp"
+#include "program.hpp"
+
+namespace gd100 {
+
+// Binary representation of frames and exit notifications, used to send them
+// between the terminal host and the Godot module.  Both sides are built from
+// the same source so the layout is native endian without any versioning.
+
+void write_frame(frame const& f, std::vector<char>& out);
+bool read_frame(char const* data, std::size_t size, frame& f);
+
+void write_exit(process_exit const& e, std::vector<char>& out);
+bool read_exit(char const* data, std::size_t size, process_exit& e);
+
+} // gd100::
+
+#endif // header guard
@@ -1,52 +1,80 @@
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
 #include <codecvt>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <locale>
 #include <mutex>
-#include <optional>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include <gdnative_api_struct.gen.h>
 
 #include "gdterm_export.h"
 #include <katerm/terminal.hpp>
+#include "tracking_decoder.hpp"
+#include "frame_encoder.hpp"
+#include "frame_ring.hpp"
+#include "frame_wire.hpp"
+#include "graphics_filter.hpp"
+#include "host_protocol.hpp"
+#include "local_echo.hpp"
+#include "output_throttle.hpp"
+#include "palette.hpp"
 #include "program.hpp"
 #include "program_terminal_manager.hpp"
+#include "pty_process.hpp"
+#include "terminal_snapshot.hpp"
+#include "text_extraction.hpp"
+#include "trace.hpp"
 
 #include <stdlib.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
 #include <unistd.h>
-#include <sys/ioctl.h>
-#include <termios.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 
 #include <gdl/api.hpp>
+#include <gdl/array.hpp>
+#include <gdl/pool_byte_array.hpp>
+#include <gdl/pool_color_array.hpp>
 #include <gdl/pool_int_array.hpp>
 #include <gdl/variant.hpp>
 #include <gdl/dictionary.hpp>
+#include <gdl/key.hpp>
 #include <gdl/string.hpp>
 
-gd100::program_terminal_manager manager;
+gd100::program_terminal_manager manager{gd100::io_backend_from_environment()};
+
+gdl::key const call_deferred_key{"call_deferred"};
+gdl::key const emit_signal_key{"emit_signal"};
+gdl::key const exited_key{"exited"};
+gdl::key const terminal_updated_key{"terminal_updated"};
 
 godot_variant_call_error object_emit_signal_deferred(
-        godot_object *p_object, gdl::string const& p_signal_name,
+        godot_object *p_object, gdl::key const& p_signal_name,
         int p_num_args, const godot_variant **p_args)
 {
+    auto const span = gd100::trace_span{"emit-deferred"};
+
     godot_variant variant;
     gdl::api->godot_variant_new_object(&variant, p_object);
 
     const godot_variant** args = (const godot_variant**)gdl::api->godot_alloc(sizeof(godot_variant *) * (p_num_args + 2));
 
-    auto const method = gdl::string{"call_deferred"};
-    auto const method_name = gdl::variant{gdl::string{"emit_signal"}};
-
-    auto const variant_signal_name = gdl::variant{p_signal_name};
-
-    args[0] = method_name.get();
-    args[1] = variant_signal_name.get();
+    args[0] = emit_signal_key.get();
+    args[1] = p_signal_name.get();
 
     for (int i = 0; i < p_num_args; i++)
     {
@@ -54,92 +82,370 @@ godot_variant_call_error object_emit_signal_deferred(
     }
 
     godot_variant_call_error error;
-    gdl::api->godot_variant_call(&variant, method.get(), args, p_num_args + 2, &error);
+    gdl::api->godot_variant_call(&variant, call_deferred_key.text(), args, p_num_args + 2, &error);
     gdl::api->godot_free(args);
     gdl::api->godot_variant_destroy(&variant);
 
     return error;
 }
 
-void get_glyph(
-        katerm::terminal const* const term,
-        int const row,
-        int const column,
-        godot_int* line_arr)
+gdl::key const lines_key{"lines"};
+gdl::key const cursor_key{"cursor"};
+gdl::key const scroll_change_key{"scroll_change"};
+gdl::key const shift_key{"shift"};
+gdl::key const palette_key{"palette"};
+gdl::key const images_key{"images"};
+gdl::key const deleted_images_key{"deleted_images"};
+gdl::key const predictions_key{"predictions"};
+
+gdl::key const id_key{"id"};
+gdl::key const column_key{"column"};
+gdl::key const row_key{"row"};
+gdl::key const width_key{"width"};
+gdl::key const height_key{"height"};
+gdl::key const format_key{"format"};
+gdl::key const data_key{"data"};
+
+gdl::key const user_time_key{"user_time"};
+gdl::key const system_time_key{"system_time"};
+gdl::key const max_rss_key{"max_rss"};
+
+gdl::variant get_line(gd100::frame const& frame, std::size_t const index)
 {
-    auto const glyph = term->screen.get_glyph({column, row});
-
-    auto fg = to_u32(glyph.style.fg);
-    auto bg = to_u32(glyph.style.bg);
-
-    if (glyph.style.mode.is_set(katerm::glyph_attr_bit::reversed))
-        std::swap(fg, bg);
-
-    line_arr[column * 3 + 0] = fg;
-    line_arr[column * 3 + 1] = bg;
-    line_arr[column * 3 + 2] = glyph.code;
-}
+    static_assert(sizeof(godot_int) == sizeof(std::int32_t));
 
-gdl::variant get_line(katerm::terminal const* const term, int const line)
-{
-    auto const width = term->screen.size().width;
+    auto const size = frame.width * gd100::cell_stride;
 
     gdl::pool_int_array line_arr;
-    line_arr.resize(width * 3);
+    line_arr.resize(size);
 
     auto write_access = gdl::api->godot_pool_int_array_write(line_arr.get());
     auto write_ptr = gdl::api->godot_pool_int_array_write_access_ptr(write_access);
 
-    for(int col = 0; col != width; ++col) {
-        get_glyph(term, line, col, write_ptr);
-    }
+    std::copy_n(frame.row_cells(index), size, write_ptr);
 
     gdl::api->godot_pool_int_array_write_access_destroy(write_access);
 
     return line_arr;
 }
 
-gdl::variant get_lines(katerm::terminal const* const term)
+gdl::variant get_lines(gd100::frame const& frame)
 {
     gdl::dictionary line_dict;
 
-    for (int line = 0; line != term->screen.size().height; ++line) {
-        auto const& termline = term->screen.lines[line];
-        if (!termline.changed)
-            continue;
+    for (std::size_t i = 0; i != frame.rows.size(); ++i)
+        line_dict.set(std::int64_t{frame.rows[i]}, get_line(frame, i));
+
+    return line_dict;
+}
+
+// Region shift as [top, bottom, delta], see gd100::region_shift.
+gdl::variant get_shift(gd100::region_shift const shift)
+{
+    gdl::pool_int_array shift_arr;
+    shift_arr.resize(3);
+    shift_arr.set(0, shift.top);
+    shift_arr.set(1, shift.bottom);
+    shift_arr.set(2, shift.delta);
+
+    return shift_arr;
+}
+
+// The cursor packed into a single int so it doesn't need an allocation: x in
+// bits 0-15, y in bits 16-31, the shape in bits 32-39, bit 40 is set when it's
+// visible and bit 41 when it blinks.
+std::int64_t get_cursor(gd100::cursor_state const& cursor)
+{
+    return std::int64_t{cursor.pos.x & 0xffff}
+         | std::int64_t{cursor.pos.y & 0xffff} << 16
+         | std::int64_t{static_cast<std::uint8_t>(cursor.style.shape)} << 32
+         | std::int64_t{cursor.style.visible} << 40
+         | std::int64_t{cursor.style.blinking} << 41;
+}
+
+gdl::variant get_palette(gd100::palette const& palette)
+{
+    gdl::pool_color_array colours;
+    colours.resize(palette.size());
+
+    for (std::size_t i = 0; i != palette.size(); ++i) {
+        auto const rgba = palette[i];
+
+        godot_color colour;
+        gdl::api->godot_color_new_rgba(
+            &colour,
+            (rgba >> 24 & 0xff) / 255.0f,
+            (rgba >> 16 & 0xff) / 255.0f,
+            (rgba >> 8 & 0xff) / 255.0f,
+            (rgba & 0xff) / 255.0f);
 
-        line_dict.set(std::int64_t{line}, get_line(term, line));
+        colours.set(i, colour);
     }
 
-    return line_dict;
+    return colours;
 }
 
-godot_variant get_cursor(katerm::terminal const* const term)
+// Placements as dictionaries with id, column and row.  The first placement of
+// an image also has width, height, format ("rgba" or "png") and data, the
+// pixels or PNG file as a PoolByteArray.
+gdl::variant get_images(gd100::frame const& frame)
 {
-    godot_vector2 cursor_pos;
-    gdl::api->godot_vector2_new(&cursor_pos, term->cursor.pos.x, term->cursor.pos.y);
+    gdl::array images;
+
+    for (auto const& placement : frame.images) {
+        gdl::dictionary entry;
+        entry.set(id_key, std::int64_t{placement.id});
+        entry.set(column_key, std::int64_t{placement.column});
+        entry.set(row_key, std::int64_t{placement.row});
+
+        if (auto const& img = placement.data) {
+            gdl::pool_byte_array data;
+            data.assign(img->data.data(), static_cast<int>(img->data.size()));
+
+            entry.set(width_key, std::int64_t{img->width});
+            entry.set(height_key, std::int64_t{img->height});
+            entry.set(format_key,
+                      gdl::string{img->format == gd100::image_format::png ? "png" : "rgba"});
+            entry.set(data_key, std::move(data));
+        }
 
-    godot_variant ret;
-    gdl::api->godot_variant_new_vector2(&ret, &cursor_pos);
+        images.append(std::move(entry));
+    }
 
-    return ret;
+    return images;
+}
+
+gdl::variant get_deleted_images(gd100::frame const& frame)
+{
+    gdl::pool_int_array ids;
+    ids.resize(frame.deleted_images.size());
+
+    for (std::size_t i = 0; i != frame.deleted_images.size(); ++i)
+        ids.set(i, static_cast<godot_int>(frame.deleted_images[i]));
+
+    return ids;
+}
+
+// Column, row and code point triples of the predicted characters, see
+// gd100::local_echo.
+gdl::variant get_predictions(std::vector<std::int32_t> const& overlay)
+{
+    gdl::pool_int_array predictions;
+    predictions.resize(overlay.size());
+
+    for (std::size_t i = 0; i != overlay.size(); ++i)
+        predictions.set(i, overlay[i]);
+
+    return predictions;
 }
 
-std::optional<gdl::variant> lines_key;
-std::optional<gdl::variant> cursor_key;
-std::optional<gdl::variant> scroll_change_key;
+// Code points of a remote terminal's screen as the frames drew it, so
+// predictions can be checked against rows a frame left out.
+class screen_codes {
+public:
+    void apply(gd100::frame const& frame)
+    {
+        if (frame.width != width) {
+            width = frame.width;
+            codes.clear();
+        }
+
+        if (frame.shift) {
+            auto const shift = *frame.shift;
+            reserve_rows(shift.bottom);
+
+            // Like the receiver, the rows that are exposed keep their old
+            // content until a frame redraws them.
+            auto const region_begin = codes.begin() + shift.top * width;
+            auto const region_end = codes.begin() + shift.bottom * width;
+            if (shift.delta > 0)
+                std::copy(region_begin + shift.delta * width, region_end, region_begin);
+            else
+                std::copy_backward(region_begin, region_end + shift.delta * width, region_end);
+        }
+
+        for (std::size_t i = 0; i != frame.rows.size(); ++i) {
+            auto const row = frame.rows[i];
+            reserve_rows(row + 1);
+
+            auto const cells = frame.row_cells(i);
+            for (int column = 0; column != width; ++column) {
+                codes[static_cast<std::size_t>(row) * width + column] =
+                    cells[column * gd100::cell_stride + 2] & gd100::cell_code_mask;
+            }
+        }
+    }
+
+    // -1 when no frame has drawn the cell.
+    long at(int const column, int const row) const
+    {
+        if (column < 0 || column >= width || row < 0)
+            return -1;
+
+        auto const index = static_cast<std::size_t>(row) * width + column;
+        return index < codes.size() ? codes[index] : -1;
+    }
+
+private:
+    void reserve_rows(int const rows)
+    {
+        auto const size = static_cast<std::size_t>(rows) * width;
+        if (codes.size() < size)
+            codes.resize(size, -1);
+    }
+
+    int width = 0;
+    std::vector<long> codes;
+};
 
-gdl::variant get_terminal_data(const katerm::terminal* const term)
+gdl::dictionary get_terminal_data(gd100::frame const& frame)
 {
+    auto const span = gd100::trace_span{"serialize-term"};
+
     gdl::dictionary term_dict;
 
-    term_dict.set(*lines_key, get_lines(term));
-    term_dict.set(*cursor_key, get_cursor(term));
-    term_dict.set(*scroll_change_key, std::int64_t{term->screen.changed_scroll()});
+    // Keys are left out when they didn't change, so a frame where only the
+    // cursor moved is a single int.
+    if (frame.shift)
+        term_dict.set(shift_key, get_shift(*frame.shift));
+
+    if (!frame.rows.empty())
+        term_dict.set(lines_key, get_lines(frame));
+
+    if (frame.cursor)
+        term_dict.set(cursor_key, get_cursor(*frame.cursor));
+
+    if (frame.scroll_change != 0)
+        term_dict.set(scroll_change_key, std::int64_t{frame.scroll_change});
+
+    if (!frame.deleted_images.empty())
+        term_dict.set(deleted_images_key, get_deleted_images(frame));
+
+    if (!frame.images.empty())
+        term_dict.set(images_key, get_images(frame));
 
     return term_dict;
 }
 
+// User data of a TerminalHub.  Updates of the terminals added to a hub wait
+// here until collect_frames instead of each going out as a deferred signal,
+// so the main thread handles all of them in one call per frame.
+class terminal_hub {
+public:
+    // Updates a terminal may have waiting for collect_frames.  Past that
+    // they're dropped and the terminal sends everything again, see deliver.
+    static constexpr std::size_t max_backlog = 64;
+
+    enum class delivery {
+        not_in_hub,
+        queued,
+        dropped, // The backlog was full, the terminal has to redraw
+    };
+
+    ~terminal_hub()
+    {
+        auto lock = std::scoped_lock{routes_mutex};
+        for (auto const id : terminals)
+            drop_route(id);
+    }
+
+    // A terminal can only be in one hub, adding it moves it here.
+    void add(std::int64_t const terminal_id)
+    {
+        auto lock = std::scoped_lock{routes_mutex};
+        routes[terminal_id] = this;
+        terminals.insert(terminal_id);
+    }
+
+    // Updates that weren't collected yet are dropped with it.
+    void remove(std::int64_t const terminal_id)
+    {
+        auto lock = std::scoped_lock{routes_mutex};
+        drop_route(terminal_id);
+        terminals.erase(terminal_id);
+        drop_backlog(terminal_id);
+    }
+
+    // Terminal id to an array of the updates since the previous call, oldest
+    // first.  Only terminals that changed are in it.
+    gdl::dictionary collect_frames()
+    {
+        {
+            auto lock = std::scoped_lock{routes_mutex};
+            std::swap(pending, collecting);
+            backlogs.clear();
+        }
+
+        for (auto& [id, update] : collecting)
+            arrays[id].append(std::move(update));
+
+        collecting.clear();
+
+        gdl::dictionary frames;
+        for (auto& [id, updates] : arrays)
+            frames.set(id, std::move(updates));
+
+        arrays.clear();
+        return frames;
+    }
+
+    // Queues the update if the terminal is in a hub, update is left alone
+    // when it isn't.  When nobody collects the frames the updates would
+    // pile up: once a terminal has max_backlog of them they're dropped along
+    // with this one, the terminal has to send its whole screen instead.
+    static delivery deliver(std::int64_t const terminal_id, gdl::dictionary& update)
+    {
+        auto lock = std::scoped_lock{routes_mutex};
+
+        auto const it = routes.find(terminal_id);
+        if (it == routes.end())
+            return delivery::not_in_hub;
+
+        auto const hub = it->second;
+        if (hub->backlogs[terminal_id] == max_backlog) {
+            hub->drop_backlog(terminal_id);
+            return delivery::dropped;
+        }
+
+        hub->pending.emplace_back(terminal_id, std::move(update));
+        ++hub->backlogs[terminal_id];
+        return delivery::queued;
+    }
+
+    static void forget(std::int64_t const terminal_id)
+    {
+        auto lock = std::scoped_lock{routes_mutex};
+        routes.erase(terminal_id);
+    }
+
+private:
+    // Requires routes_mutex to be held.
+    void drop_route(std::int64_t const terminal_id)
+    {
+        auto const it = routes.find(terminal_id);
+        if (it != routes.end() && it->second == this)
+            routes.erase(it);
+    }
+
+    // Requires routes_mutex to be held.
+    void drop_backlog(std::int64_t const terminal_id)
+    {
+        std::erase_if(pending, [&](auto const& entry) { return entry.first == terminal_id; });
+        backlogs.erase(terminal_id);
+    }
+
+    static inline std::mutex routes_mutex;
+    static inline std::unordered_map<std::int64_t, terminal_hub*> routes;
+
+    std::unordered_set<std::int64_t> terminals; // guarded by routes_mutex
+    std::vector<std::pair<std::int64_t, gdl::dictionary>> pending; // guarded by routes_mutex
+    std::unordered_map<std::int64_t, std::size_t> backlogs; // guarded by routes_mutex, size per terminal
+
+    // Only used by collect_frames, kept around for their capacity.
+    std::vector<std::pair<std::int64_t, gdl::dictionary>> collecting;
+    std::unordered_map<std::int64_t, gdl::array> arrays;
+};
+
 enum class godot_mouse_button : int {
     none = 0,
     left = 1,
@@ -185,87 +491,148 @@ bool can_be_held(terminal_mouse_button m)
     }
 }
 
-template<class F>
-auto time_call(char const* const label, const F& f)
-{
-    auto const before = std::chrono::steady_clock::now();
-    auto const ret = f();
-    auto const after = std::chrono::steady_clock::now();
-
-    auto const diff = std::chrono::duration<double, std::milli>{after - before};
-
-    std::cout << diff.count() << " ms :: " << label << '\n';
-
-    return ret;
-}
-
-class terminal_program : public gd100::program {
+// State and input handling shared by terminals decoded in this process and
+// terminals running in the terminal host.  A TerminalLogic instance's user
+// data points to one of these.
+class terminal_session {
 public:
-    katerm::terminal terminal;
     int master_descriptor;
+
+    // Null once the TerminalLogic is destroyed, a program can still be
+    // decoding on the controller thread then.  Only changed and used with
+    // the terminal's mutex held, nothing is emitted after it's cleared.
     godot_object* instance;
-    katerm::decoder decoder;
 
-    // Mutex necessary to protect access to the terminal and related things.
-    //
-    // Multi-threaded access can happen when Godot performs some action on the
-    // terminal and at the same time data is written to the master_descriptor
-    // which is then decoded in handle_bytes.
-    //
-    // This is not necessary to write/read to the master_descriptor since the
-    // kernel guarantees these operations are atomic.
-    std::mutex terminal_mutex;
+    // Identifies the terminal to a TerminalHub.
+    std::int64_t const terminal_id = next_terminal_id++;
 
     // -1 so that the first reported mouse position is seen as different.
     int previous_x = -1;
     int previous_y = -1;
     terminal_mouse_button held_button = terminal_mouse_button::none;
 
-    terminal_program(katerm::terminal t, int const md, godot_object* const i)
-        : terminal{std::move(t)}
-        , master_descriptor{md}
+    terminal_session(int const md, godot_object* const i)
+        : master_descriptor{md}
         , instance{i}
     {
     }
 
-    ~terminal_program()
+    virtual ~terminal_session()
     {
+        terminal_hub::forget(terminal_id);
         close(master_descriptor);
     }
 
-    void handle_bytes(const char* bytes, std::size_t const count, bool const more_data_coming) override
+    void emit_exited(gd100::process_exit const& exit_info)
     {
-        auto lock = std::scoped_lock{terminal_mutex};
+        if (!instance)
+            return;
 
-        katerm::terminal_instructee t{&terminal};
-        time_call("decode", [&] { decoder.decode(bytes, count, t); return 0; });
-
-        if (!more_data_coming) {
-            auto data = time_call("serialize-term", [&] { return get_terminal_data(&terminal); });
-            terminal.screen.clear_changes();
-            const auto* args = data.get();
-            object_emit_signal_deferred(
-                instance,
-                "terminal_updated",
-                1,
-                &args);
+        using seconds = std::chrono::duration<double>;
+
+        gdl::dictionary usage;
+        usage.set(user_time_key, seconds{exit_info.user_time}.count());
+        usage.set(system_time_key, seconds{exit_info.system_time}.count());
+        usage.set(max_rss_key, std::int64_t{exit_info.max_rss});
+
+        auto const code = gdl::variant{std::int64_t{exit_info.code}};
+        auto const usage_variant = gdl::variant{std::move(usage)};
+
+        const godot_variant* args[]{code.get(), usage_variant.get()};
+        object_emit_signal_deferred(
+            instance,
+            exited_key,
+            2,
+            args);
+    }
+
+    // Colours to use for cells with palette indices, entries beyond the ones
+    // given stay at their default.
+    void set_palette(std::vector<godot_color> const& colours)
+    {
+        gdl::dictionary update;
+
+        {
+            auto lock = std::scoped_lock{palette_mutex};
+
+            palette = gd100::default_palette;
+            auto const count = std::min(colours.size(), palette.size());
+            for (std::size_t i = 0; i != count; ++i)
+                palette[i] = static_cast<std::uint32_t>(gdl::api->godot_color_to_rgba32(&colours[i]));
+
+            update.set(palette_key, get_palette(palette));
+            palette_sent = true;
         }
 
-#if 0
-        std::cerr << "Received " << count << " bytes.\n";
-        for(char* b = bytes; b != bytes + count; ++b) {
-            std::cerr << ((int)*b) << " ";
+        // The lines only refer to the palette, so this is the whole theme
+        // switch.
+        emit_update(std::move(update));
+    }
+
+    // Set when updates were dropped, the next one has to hold the whole
+    // screen.  Picked up by the controller, it's woken for it.
+    std::atomic<bool> redraw_due = false;
+
+    // Sends a terminal_updated signal, or queues the update when the
+    // terminal is in a TerminalHub.  The first one also gets the palette.
+    void emit_update(gdl::dictionary update)
+    {
+        if (!instance)
+            return;
+
+        {
+            auto lock = std::scoped_lock{palette_mutex};
+            if (!palette_sent) {
+                update.set(palette_key, get_palette(palette));
+                palette_sent = true;
+            }
         }
 
-        std::cerr << "\n\n\n";
-#endif
+        switch (terminal_hub::deliver(terminal_id, update)) {
+            case terminal_hub::delivery::not_in_hub:
+                break;
+
+            case terminal_hub::delivery::queued:
+                return;
+
+            case terminal_hub::delivery::dropped:
+                // The palette may have been in one of the dropped updates.
+                {
+                    auto lock = std::scoped_lock{palette_mutex};
+                    palette_sent = false;
+                }
+
+                redraw_due = true;
+                manager.recheck_deadlines();
+                return;
+        }
+
+        auto const data = gdl::variant{std::move(update)};
+        const auto* args = data.get();
+        object_emit_signal_deferred(
+            instance,
+            terminal_updated_key,
+            1,
+            &args);
     }
 
     void send_code(katerm::code_point const code)
     {
+        // Queued before writing, the controller takes the keystrokes before
+        // it decodes output, so the echo can't be decoded before its
+        // prediction exists.
+        if (predicting) {
+            {
+                auto lock = std::scoped_lock{keystrokes_mutex};
+                keystrokes.push_back({code, gd100::local_echo::clock::now()});
+            }
+
+            manager.recheck_deadlines();
+        }
+
         std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> converter;
         std::string u8str = converter.to_bytes(code);
-        write(master_descriptor, u8str.c_str(), u8str.size());
+        manager.write_input(master_descriptor, u8str.c_str(), u8str.size());
     }
 
     void process_mouse(
@@ -284,14 +651,7 @@ public:
 
         bool const released = button != terminal_mouse_button::none && !pressed;
 
-        katerm::mouse_mode mode;
-        bool is_sgr;
-
-        {
-            auto lock = std::scoped_lock{terminal_mutex};
-            mode = terminal.mouse;
-            is_sgr = terminal.mode.is_set(katerm::terminal_mode_bit::extended_mouse);
-        }
+        auto const [mode, is_sgr] = get_mouse_settings();
 
         if (mode == katerm::mouse_mode::none) return;
         if (mode == katerm::mouse_mode::x10 && !pressed) return;
@@ -336,7 +696,7 @@ public:
             mouse_data[5] = 32 + mouse_y + 1;
             mouse_data[3] = 32 + (released ? 3 : button_code);
 
-            write(master_descriptor, mouse_data, sizeof(mouse_data));
+            manager.write_input(master_descriptor, mouse_data, sizeof(mouse_data));
         } else {
             char sgr_buffer[64]{};
             auto const message_length =
@@ -344,137 +704,1011 @@ public:
                               "\x1b[<%d;%d;%d%c",
                               button_code, mouse_x + 1, mouse_y + 1,
                               released ? 'm' : 'M');
-            write(master_descriptor, sgr_buffer, message_length);
+            manager.write_input(master_descriptor, sgr_buffer, message_length);
         }
     }
-};
 
-godot_variant send_code_method(
-        godot_object* const obj,
-        void* const method_data,
-        void* const user_data,
-        int const num_args,
-        godot_variant** const args)
-{
-    if (num_args != 1) {
-        godot_variant ret;
-        gdl::api->godot_variant_new_nil(&ret);
-        return ret;
-    }
+private:
+    static inline std::atomic<std::int64_t> next_terminal_id = 1;
 
-    auto const code = gdl::api->godot_variant_as_int(args[0]);
+    std::mutex palette_mutex;
+    gd100::palette palette = gd100::default_palette;
+    bool palette_sent = false;
 
-    auto term = reinterpret_cast<terminal_program*>(user_data);
-    term->send_code(code);
+protected:
+    struct mouse_settings {
+        katerm::mouse_mode mode;
+        bool is_sgr;
+    };
 
-    godot_variant ret;
-    gdl::api->godot_variant_new_nil(&ret);
-    return ret;
-}
+    virtual mouse_settings get_mouse_settings() = 0;
 
-godot_variant send_mouse_method(
-        godot_object* const obj,
-        void* const method_data,
-        void* const user_data,
-        int const num_args,
-        godot_variant** const args)
-{
-    if (num_args != 4) {
-        godot_variant ret;
-        gdl::api->godot_variant_new_nil(&ret);
-        return ret;
-    }
+public:
+    // Predictive echo, emits the overlay right away when it changes.
+    virtual void set_predictive_echo(bool enabled) = 0;
+
+protected:
+    // Typed keys go through a queue of their own instead of the terminal's
+    // mutex, so typing doesn't wait for a flood of output to be decoded.
+    // The controller thread turns them into predictions, it's woken with
+    // recheck_deadlines and sees them through flush_deadline.
+    struct keystroke {
+        katerm::code_point code;
+        gd100::local_echo::clock::time_point time;
+    };
 
-    auto const mouse_x = gdl::api->godot_variant_as_int(args[0]);
-    auto const mouse_y = gdl::api->godot_variant_as_int(args[1]);
-    auto const button_nr = gdl::api->godot_variant_as_int(args[2]);
-    auto const godot_button = static_cast<godot_mouse_button>(button_nr);
-    auto const button = to_terminal_mouse(godot_button);
-    auto const pressed = gdl::api->godot_variant_as_bool(args[3]);
+    // Set by set_predictive_echo, no keystrokes are queued without it.
+    std::atomic<bool> predicting = false;
 
-    auto term = reinterpret_cast<terminal_program*>(user_data);
-    term->process_mouse(mouse_x, mouse_y, button, pressed);
+    bool has_keystrokes()
+    {
+        auto lock = std::scoped_lock{keystrokes_mutex};
+        return !keystrokes.empty();
+    }
 
-    godot_variant ret;
-    gdl::api->godot_variant_new_nil(&ret);
-    return ret;
-}
+    // Called on the controller thread with the terminal's mutex held, cell
+    // is passed on to local_echo::typed.  Returns whether the overlay
+    // changed.
+    template<class CellLookup>
+    bool take_keystrokes(
+            gd100::local_echo& echo,
+            katerm::position const cursor,
+            int const width,
+            CellLookup const& cell)
+    {
+        {
+            auto lock = std::scoped_lock{keystrokes_mutex};
+            taken_keystrokes.swap(keystrokes);
+        }
 
-terminal_program* start_program(godot_object* const instance)
-{
-    auto const masterfd = posix_openpt(O_RDWR | O_NOCTTY);
-    grantpt(masterfd);
-    unlockpt(masterfd);
-    auto const slavename = ptsname(masterfd);
-    auto const slavefd = open(slavename, O_RDWR | O_NOCTTY);
-    if (slavefd < 0) {
-        throw std::runtime_error{"Opening pseudoterminal slave failed."};
-    }
-    auto const fork_result = fork();
+        auto changed = false;
+        for (auto const& key : taken_keystrokes)
+            changed |= echo.typed(key.code, cursor, width, cell, key.time);
 
-    // child
-    if (fork_result == 0) {
-        close(masterfd);
+        taken_keystrokes.clear();
+        return changed;
+    }
 
-        setsid();
-        ioctl(slavefd, TIOCSCTTY, 0);
+    void emit_predictions(gd100::local_echo const& echo)
+    {
+        gdl::dictionary update;
+        update.set(predictions_key, get_predictions(echo.overlay()));
+        emit_update(std::move(update));
+    }
 
-        close(0);
-        close(1);
-        close(2);
-        dup2(slavefd, 0);
-        dup2(slavefd, 1);
-        dup2(slavefd, 2);
+private:
+    std::mutex keystrokes_mutex;
+    std::vector<keystroke> keystrokes;
+    std::vector<keystroke> taken_keystrokes; // Only used by take_keystrokes
+};
 
-        setenv("TERM", "gdterm", 1);
+class terminal_program : public gd100::program, public terminal_session {
+public:
+    katerm::terminal terminal;
+    gd100::tracking_decoder decoder;
+    gd100::frame_encoder encoder;
+    gd100::graphics_filter graphics;
+    gd100::local_echo echo;
 
-        char command[] = "sh";
+    // Mutex necessary to protect access to the terminal and related things.
+    //
+    // Multi-threaded access can happen when Godot performs some action on the
+    // terminal and at the same time data is written to the master_descriptor
+    // which is then decoded in handle_bytes.
+    //
+    // This is not necessary to write/read to the master_descriptor since the
+    // kernel guarantees these operations are atomic.
+    std::mutex terminal_mutex;
 
-        char* const args[]{
-            command,
-            nullptr,
-        };
+    // Limits serialization to once per frame while the program floods us
+    // with output.
+    gd100::output_throttle throttle;
 
-        execvp(command, args);
+    terminal_program(katerm::terminal t, int const md, godot_object* const i)
+        : terminal_session{md, i}
+        , terminal{std::move(t)}
+    {
     }
 
-    if (fork_result == -1) {
-        abort();
-    }
+    void handle_bytes(const char* bytes, std::size_t const count, bool const more_data_coming) override
+    {
+        auto lock = std::scoped_lock{terminal_mutex};
 
-    // parent
+        auto const now = gd100::output_throttle::clock::now();
+        throttle.record_bytes(count, now);
 
-    close(slavefd);
+        auto const typed = take_keystrokes(
+            echo, terminal.cursor.pos, terminal.screen.size().width,
+            [this](int const column, int const row) { return cell_code(column, row); });
 
-    auto const size = katerm::extend{132, 35};
+        // The receiver missed updates, it gets everything again and drops
+        // its images like after load_state.  The predictions go along.
+        auto const redrawing = redraw_due.exchange(false);
+        if (redrawing) {
+            encoder.reset();
+            graphics.reset();
+        }
 
+        {
+            auto const span = gd100::trace_span{"decode"};
+            graphics.feed(bytes, count, terminal, decoder);
+        }
 
-    auto const winsz = winsize{
-        static_cast<unsigned short>(size.height),
-        static_cast<unsigned short>(size.width),
-        0, 0
-    };
+        if (auto const responses = graphics.take_responses(); !responses.empty())
+            manager.write_input(master_descriptor, responses.data(), responses.size());
 
-    if(ioctl(masterfd, TIOCSWINSZ, &winsz))
-        throw std::runtime_error{"Couldn't set window size."};
+        if (!more_data_coming && throttle.should_flush(now)) {
+            send_update(typed || redrawing);
+            throttle.flushed(now);
+        } else if (echo.expire(now) || typed || redrawing) {
+            // Expiring only happens on the flush for the echo deadline, the
+            // program stayed silent.
+            emit_predictions(echo);
+        }
 
-    auto program = std::make_unique<terminal_program>(
-        katerm::terminal{size},
-        masterfd,
-        instance
-    );
+#if 0
+        std::cerr << "Received " << count << " bytes.\n";
+        for(char* b = bytes; b != bytes + count; ++b) {
+            std::cerr << ((int)*b) << " ";
+        }
 
-    return (terminal_program*)manager.register_program(masterfd, std::move(program));
+        std::cerr << "\n\n\n";
+#endif
+    }
+
+    clock::time_point flush_deadline() override
+    {
+        if (has_keystrokes() || redraw_due)
+            return clock::time_point::min();
+
+        auto lock = std::scoped_lock{terminal_mutex};
+        return std::min(throttle.deadline(), echo.deadline());
+    }
+
+    void handle_exit(gd100::process_exit const& exit_info) override
+    {
+        auto lock = std::scoped_lock{terminal_mutex};
+        emit_exited(exit_info);
+    }
+
+    // Called before the program is removed from the manager.
+    void detach()
+    {
+        auto lock = std::scoped_lock{terminal_mutex};
+        instance = nullptr;
+    }
+
+    std::string get_text(katerm::position const start, katerm::position const end, int const options)
+    {
+        auto lock = std::scoped_lock{terminal_mutex};
+        return gd100::extract_text(terminal, start, end, options);
+    }
+
+    std::string get_line_text(int const row)
+    {
+        auto lock = std::scoped_lock{terminal_mutex};
+        return gd100::extract_line_text(terminal, row);
+    }
+
+    std::vector<char> save_state()
+    {
+        auto lock = std::scoped_lock{terminal_mutex};
+        return gd100::save_snapshot(terminal, decoder.cursor());
+    }
+
+    bool load_state(std::vector<char> const& state)
+    {
+        auto lock = std::scoped_lock{terminal_mutex};
+        if (!gd100::restore_snapshot(state.data(), state.size(), terminal, decoder))
+            return false;
+
+        // What's on screen has nothing to do with what was sent before.
+        encoder.reset();
+        graphics.reset();
+        send_update();
+        return true;
+    }
+
+private:
+    // Requires terminal_mutex to be held, -1 outside of the screen.
+    long cell_code(int const column, int const row) const
+    {
+        auto const size = terminal.screen.size();
+        if (column < 0 || column >= size.width || row < 0 || row >= size.height)
+            return -1;
+
+        return terminal.screen.get_glyph({column, row}).code;
+    }
+
+    // Requires terminal_mutex to be held.  predictions_changed is set when
+    // the overlay changed since it was last emitted.
+    void send_update(bool predictions_changed = false)
+    {
+        auto frame = encoder.encode(terminal, decoder.cursor());
+        graphics.take_updates(frame);
+        terminal.screen.clear_changes();
+
+        auto const cell = [this](int const column, int const row) { return cell_code(column, row); };
+        predictions_changed |=
+            echo.reconcile(terminal.cursor.pos, cell, gd100::local_echo::clock::now());
+
+        if (frame.empty() && !predictions_changed)
+            return;
+
+        auto data = get_terminal_data(frame);
+
+        // Together with the lines that confirm them, so the echo replaces
+        // the predictions without flickering.
+        if (predictions_changed)
+            data.set(predictions_key, get_predictions(echo.overlay()));
+
+        emit_update(std::move(data));
+    }
+
+public:
+    void set_predictive_echo(bool const enabled) override
+    {
+        auto lock = std::scoped_lock{terminal_mutex};
+        predicting = enabled;
+        if (echo.set_enabled(enabled))
+            emit_predictions(echo);
+    }
+
+protected:
+    mouse_settings get_mouse_settings() override
+    {
+        auto lock = std::scoped_lock{terminal_mutex};
+        return {
+            terminal.mouse,
+            terminal.mode.is_set(katerm::terminal_mode_bit::extended_mouse),
+        };
+    }
+};
+
+class terminal_host;
+
+// Terminal that lives in the terminal host, only input handling happens in
+// this process.
+class remote_terminal : public terminal_session {
+public:
+    std::uint32_t const id;
+
+    // Stays valid after the host process is gone, the manager keeps it.
+    terminal_host* const owner;
+
+    // Guarded by the owner's mutex.
+    bool exit_reported = false;
+
+    remote_terminal(std::uint32_t const i, int const md, godot_object* const inst, terminal_host* const o)
+        : terminal_session{md, inst}
+        , id{i}
+        , owner{o}
+    {
+    }
+
+    // Emits a frame from the host.  Predictions are checked against the
+    // screen as the frames drew it.
+    void publish(gd100::frame const& frame)
+    {
+        auto lock = std::scoped_lock{mutex};
+
+        auto const cell = [this](int const column, int const row) { return screen.at(column, row); };
+
+        // With the screen of the frame before, like the host saw it when the
+        // keys arrived there.
+        auto const typed = take_keystrokes(echo, cursor, width, cell);
+
+        mouse = {frame.mouse, frame.sgr_mouse};
+        width = frame.width;
+        if (frame.cursor)
+            cursor = frame.cursor->pos;
+
+        screen.apply(frame);
+
+        auto data = get_terminal_data(frame);
+
+        if (echo.reconcile(cursor, cell, gd100::local_echo::clock::now()) || typed)
+            data.set(predictions_key, get_predictions(echo.overlay()));
+
+        emit_update(std::move(data));
+    }
+
+    void set_predictive_echo(bool const enabled) override
+    {
+        auto lock = std::scoped_lock{mutex};
+        predicting = enabled;
+        if (echo.set_enabled(enabled))
+            emit_predictions(echo);
+    }
+
+    // When the host connection has to call catch_up.
+    gd100::local_echo::clock::time_point deadline()
+    {
+        if (has_keystrokes() || redraw_due)
+            return gd100::local_echo::clock::time_point::min();
+
+        auto lock = std::scoped_lock{mutex};
+        return echo.deadline();
+    }
+
+    // Takes the keystrokes typed since the last frame and expires the
+    // predictions.  Returns whether the host has to send the whole screen
+    // again, the predictions are sent again right away then.
+    bool catch_up(gd100::local_echo::clock::time_point const now)
+    {
+        auto lock = std::scoped_lock{mutex};
+        auto const cell = [this](int const column, int const row) { return screen.at(column, row); };
+        auto const typed = take_keystrokes(echo, cursor, width, cell);
+        auto const redrawing = redraw_due.exchange(false);
+
+        if (echo.expire(now) || typed || redrawing)
+            emit_predictions(echo);
+
+        return redrawing;
+    }
+
+protected:
+    mouse_settings get_mouse_settings() override
+    {
+        auto lock = std::scoped_lock{mutex};
+        return mouse;
+    }
+
+private:
+    // Held while emitting so predictions and frames go out in order.
+    std::mutex mutex;
+    mouse_settings mouse{katerm::mouse_mode::none, false};
+
+    // As of the last frame from the host.
+    katerm::position cursor{0, 0};
+    int width = 0;
+    screen_codes screen;
+    gd100::local_echo echo;
+};
+
+// Connection to a gd100-terminal-host process.
+//
+// Registered with the manager on the ring's eventfd, so the controller thread
+// turns the host's records into signals just like it does for local output.
+// How long the host gets to say hello, the game waits for it on the main
+// thread.
+constexpr auto host_hello_timeout = std::chrono::seconds{2};
+
+// Waits until the descriptor is readable, false when the timeout passed first.
+bool wait_readable(int const descriptor, std::chrono::milliseconds const timeout)
+{
+    auto const deadline = std::chrono::steady_clock::now() + timeout;
+
+    for (;;) {
+        auto const left = std::chrono::ceil<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+
+        pollfd readable{descriptor, POLLIN, 0};
+        auto const result = poll(&readable, 1, static_cast<int>(std::max<std::int64_t>(left.count(), 0)));
+        if (result > 0)
+            return true;
+
+        if (result == 0 || errno != EINTR)
+            return false;
+    }
+}
+
+class terminal_host : public gd100::program {
+public:
+    // Starts the host executable at path, returns nullptr if that fails.
+    static terminal_host* start(char const* const path)
+    {
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets))
+            return nullptr;
+
+        // dup2 onto the same descriptor wouldn't clear close-on-exec.
+        auto child_end = sockets[1];
+        if (child_end == gd100::host_control_descriptor) {
+            child_end = fcntl(sockets[1], F_DUPFD_CLOEXEC, gd100::host_control_descriptor + 1);
+            close(sockets[1]);
+        }
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, child_end, gd100::host_control_descriptor);
+
+        char* const args[]{const_cast<char*>(path), nullptr};
+
+        // posix_spawn doesn't copy the page tables of the game like fork
+        // does, which is the whole point of the host.
+        pid_t pid;
+        auto const spawn_result = posix_spawn(&pid, path, &actions, nullptr, args, environ);
+        posix_spawn_file_actions_destroy(&actions);
+        close(child_end);
+
+        if (spawn_result) {
+            close(sockets[0]);
+            return nullptr;
+        }
+
+        // Whatever path points to might never answer, or not be the host at
+        // all.
+        gd100::host_hello hello;
+        int shared[2]{-1, -1};
+        if (!wait_readable(sockets[0], host_hello_timeout)
+            || !gd100::receive_message(sockets[0], &hello, sizeof(hello), shared, 2)
+            || hello.version != gd100::host_protocol_version
+            || shared[0] < 0 || shared[1] < 0) {
+            for (auto const fd : shared) {
+                if (fd >= 0) close(fd);
+            }
+
+            close(sockets[0]);
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+            return nullptr;
+        }
+
+        auto host = std::unique_ptr<terminal_host>{
+            new terminal_host{sockets[0], gd100::frame_ring::attach(shared[0]), shared[1]}};
+
+        auto const ret = (terminal_host*)manager.register_program(shared[1], pid, std::move(host));
+
+        // The ring carries the focused terminal's frames too, and the host
+        // already did the expensive part.
+        manager.set_focused(shared[1], true);
+        return ret;
+    }
+
+    remote_terminal* spawn(godot_object* const instance, katerm::extend const size)
+    {
+        auto lock = std::scoped_lock{mutex};
+
+        auto const id = next_id++;
+        auto const request = gd100::host_request{
+            gd100::host_request_type::spawn, id, size.width, size.height};
+
+        gd100::host_spawn_reply reply;
+        int master;
+        if (!gd100::send_message(control, &request, sizeof(request), nullptr, 0)
+            || !gd100::receive_message(control, &reply, sizeof(reply), &master, 1)
+            || reply.pid < 0 || master < 0)
+            throw std::runtime_error{"Terminal host couldn't start a program."};
+
+        auto term = std::make_unique<remote_terminal>(id, master, instance, this);
+        auto ret = term.get();
+        terminals[id] = std::move(term);
+
+        return ret;
+    }
+
+    void close_terminal(remote_terminal* const term)
+    {
+        auto lock = std::scoped_lock{mutex};
+
+        auto const request = gd100::host_request{
+            gd100::host_request_type::close, term->id, 0, 0};
+        gd100::send_message(control, &request, sizeof(request), nullptr, 0);
+
+        terminals.erase(term->id);
+    }
+
+    void set_focused(remote_terminal* const term, bool const focused)
+    {
+        auto lock = std::scoped_lock{mutex};
+
+        auto const request = gd100::host_request{
+            gd100::host_request_type::focus, term->id, focused ? 1 : 0, 0};
+        gd100::send_message(control, &request, sizeof(request), nullptr, 0);
+    }
+
+    void handle_bytes(const char*, std::size_t, bool) override
+    {
+        // The bytes are just the eventfd counter, the records are in the ring.
+        auto lock = std::scoped_lock{mutex};
+        drain_records();
+
+        // Frames reconcile the predictions, this clears the ones of
+        // terminals that stayed silent and takes keystrokes typed since.
+        auto const now = gd100::local_echo::clock::now();
+        for (auto const& [id, term] : terminals) {
+            if (!term->catch_up(now))
+                continue;
+
+            auto const request = gd100::host_request{
+                gd100::host_request_type::redraw, id, 0, 0};
+            gd100::send_message(control, &request, sizeof(request), nullptr, 0);
+        }
+    }
+
+    // The ring's eventfd only wakes the controller for frames, predictions
+    // expire by deadline, keystrokes and redraws are taken care of right
+    // away.
+    clock::time_point flush_deadline() override
+    {
+        auto lock = std::scoped_lock{mutex};
+
+        auto ret = clock::time_point::max();
+        for (auto const& [id, term] : terminals)
+            ret = std::min(ret, term->deadline());
+
+        return ret;
+    }
+
+    // The shells went down with the host.  Their terminals are told they
+    // exited, new ones are started in-process, see get_host.
+    void handle_exit(gd100::process_exit const& exit_info) override
+    {
+        std::cerr << "Terminal host exited with code " << exit_info.code << ".\n";
+
+        auto lock = std::scoped_lock{mutex};
+
+        // What it wrote before it died is still in the ring.
+        drain_records();
+
+        auto const lost = gd100::process_exit{-1, {}, {}, 0};
+        for (auto const& [id, term] : terminals) {
+            if (!std::exchange(term->exit_reported, true))
+                term->emit_exited(lost);
+        }
+
+        exited = true;
+    }
+
+    bool has_exited() const noexcept
+    {
+        return exited;
+    }
+
+    ~terminal_host()
+    {
+        close(control);
+    }
+
+private:
+    terminal_host(int const c, gd100::frame_ring r, int const e)
+        : control{c}
+        , ring{std::move(r)}
+        , event_descriptor{e}
+    {
+    }
+
+    // Requires mutex to be held.
+    void drain_records()
+    {
+        ring.drain([&](auto const kind, void const* const data, std::size_t const size) {
+            std::uint32_t id;
+            if (size < sizeof(id))
+                return;
+
+            std::memcpy(&id, data, sizeof(id));
+
+            auto const it = terminals.find(id);
+            if (it == terminals.end())
+                return;
+
+            auto const term = it->second.get();
+            auto const payload = static_cast<char const*>(data) + sizeof(id);
+            auto const payload_size = size - sizeof(id);
+
+            switch (static_cast<gd100::host_record_kind>(kind)) {
+                case gd100::host_record_kind::frame: {
+                    if (!gd100::read_frame(payload, payload_size, received))
+                        return;
+
+                    term->publish(received);
+                    break;
+                }
+
+                case gd100::host_record_kind::exit: {
+                    gd100::process_exit exit_info;
+                    if (gd100::read_exit(payload, payload_size, exit_info)
+                        && !std::exchange(term->exit_reported, true))
+                        term->emit_exited(exit_info);
+                    break;
+                }
+            }
+        });
+    }
+
+    int control;
+    gd100::frame_ring ring;
+    int event_descriptor; // Owned by the manager's registration
+
+    std::mutex mutex;
+    std::unordered_map<std::uint32_t, std::unique_ptr<remote_terminal>> terminals;
+    std::uint32_t next_id = 0;
+    gd100::frame received;
+    std::atomic<bool> exited = false;
+};
+
+godot_variant send_code_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    if (num_args != 1) {
+        godot_variant ret;
+        gdl::api->godot_variant_new_nil(&ret);
+        return ret;
+    }
+
+    auto const code = gdl::api->godot_variant_as_int(args[0]);
+
+    auto term = reinterpret_cast<terminal_session*>(user_data);
+    term->send_code(code);
+
+    godot_variant ret;
+    gdl::api->godot_variant_new_nil(&ret);
+    return ret;
+}
+
+godot_variant send_mouse_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    if (num_args != 4) {
+        godot_variant ret;
+        gdl::api->godot_variant_new_nil(&ret);
+        return ret;
+    }
+
+    auto const mouse_x = gdl::api->godot_variant_as_int(args[0]);
+    auto const mouse_y = gdl::api->godot_variant_as_int(args[1]);
+    auto const button_nr = gdl::api->godot_variant_as_int(args[2]);
+    auto const godot_button = static_cast<godot_mouse_button>(button_nr);
+    auto const button = to_terminal_mouse(godot_button);
+    auto const pressed = gdl::api->godot_variant_as_bool(args[3]);
+
+    auto term = reinterpret_cast<terminal_session*>(user_data);
+    term->process_mouse(mouse_x, mouse_y, button, pressed);
+
+    godot_variant ret;
+    gdl::api->godot_variant_new_nil(&ret);
+    return ret;
+}
+
+katerm::position to_position(godot_variant const* const v)
+{
+    auto const vector = gdl::api->godot_variant_as_vector2(v);
+    return {
+        static_cast<int>(gdl::api->godot_vector2_get_x(&vector)),
+        static_cast<int>(gdl::api->godot_vector2_get_y(&vector)),
+    };
+}
+
+godot_variant to_string_variant(std::string const& text)
+{
+    return gdl::to_variant_handle(gdl::string{text.data(), static_cast<int>(text.size())});
+}
+
+// Text is only available for terminals decoded in this process, terminals in
+// the terminal host return an empty string.
+godot_variant get_text_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    auto term = dynamic_cast<terminal_program*>(reinterpret_cast<terminal_session*>(user_data));
+    if (num_args != 3 || !term)
+        return to_string_variant({});
+
+    auto const start = to_position(args[0]);
+    auto const end = to_position(args[1]);
+    auto const options = gdl::api->godot_variant_as_int(args[2]);
+
+    return to_string_variant(term->get_text(start, end, static_cast<int>(options)));
+}
+
+godot_variant get_line_text_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    auto term = dynamic_cast<terminal_program*>(reinterpret_cast<terminal_session*>(user_data));
+    if (num_args != 1 || !term)
+        return to_string_variant({});
+
+    auto const row = gdl::api->godot_variant_as_int(args[0]);
+    return to_string_variant(term->get_line_text(static_cast<int>(row)));
+}
+
+// Like the text methods, state can only be saved and loaded for terminals
+// decoded in this process.
+godot_variant save_state_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    gdl::pool_byte_array state;
+
+    auto term = dynamic_cast<terminal_program*>(reinterpret_cast<terminal_session*>(user_data));
+    if (term) {
+        // An empty array is rejected by load_state.
+        try {
+            auto const bytes = term->save_state();
+            state.assign(bytes.data(), static_cast<int>(bytes.size()));
+        } catch (std::exception const& e) {
+            std::cerr << "Couldn't save terminal state: " << e.what() << '\n';
+        }
+    }
+
+    return gdl::to_variant_handle(state);
+}
+
+godot_variant load_state_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    auto loaded = false;
+
+    auto term = dynamic_cast<terminal_program*>(reinterpret_cast<terminal_session*>(user_data));
+    if (num_args == 1 && term) {
+        auto const state = gdl::pool_byte_array{gdl::api->godot_variant_as_pool_byte_array(args[0])};
+        loaded = term->load_state(state.contents());
+    }
+
+    godot_variant ret;
+    gdl::api->godot_variant_new_bool(&ret, loaded);
+    return ret;
+}
+
+godot_variant set_palette_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    if (num_args == 1) {
+        auto const colours = gdl::pool_color_array{gdl::api->godot_variant_as_pool_color_array(args[0])};
+
+        auto term = reinterpret_cast<terminal_session*>(user_data);
+        term->set_palette(colours.contents());
+    }
+
+    godot_variant ret;
+    gdl::api->godot_variant_new_nil(&ret);
+    return ret;
+}
+
+godot_variant set_tracing_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    if (num_args == 1)
+        gd100::set_tracing(gdl::api->godot_variant_as_bool(args[0]));
+
+    godot_variant ret;
+    gdl::api->godot_variant_new_nil(&ret);
+    return ret;
+}
+
+// Dumps the spans recorded in this process so far, returns whether the file
+// could be written.
+godot_variant write_trace_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    auto written = false;
+
+    if (num_args == 1) {
+        auto const path = gdl::string{gdl::api->godot_variant_as_string(args[0])};
+        written = gd100::write_trace(path.utf8().c_str());
+    }
+
+    godot_variant ret;
+    gdl::api->godot_variant_new_bool(&ret, written);
+    return ret;
+}
+
+constexpr auto terminal_size = katerm::extend{132, 35};
+
+// Set when the GD100_TERMINAL_HOST environment variable points to the host
+// executable and it could be started.
+terminal_host* host = nullptr;
+bool host_checked = false;
+
+terminal_host* get_host()
+{
+    // Its terminals still refer to it, only new ones go elsewhere.
+    if (host && host->has_exited()) {
+        std::cerr << "Terminal host is gone, decoding in-process.\n";
+        host = nullptr;
+    }
+
+    if (!host_checked) {
+        host_checked = true;
+
+        if (auto const path = std::getenv("GD100_TERMINAL_HOST")) {
+            host = terminal_host::start(path);
+            if (!host)
+                std::cerr << "Couldn't start terminal host " << path << ", decoding in-process.\n";
+        }
+    }
+
+    return host;
+}
+
+terminal_session* start_program(godot_object* const instance)
+{
+    if (auto const h = get_host()) {
+        try {
+            return h->spawn(instance, terminal_size);
+        } catch (std::exception const& e) {
+            std::cerr << e.what() << " Starting it in-process.\n";
+        }
+    }
+
+    auto const process = gd100::spawn_shell(terminal_size);
+
+    auto program = std::make_unique<terminal_program>(
+        katerm::terminal{terminal_size},
+        process.master_descriptor,
+        instance
+    );
+
+    return (terminal_program*)manager.register_program(
+        process.master_descriptor, process.pid, std::move(program));
 }
 
 void* create_terminal(godot_object* const instance, void* const method_data)
 {
-    return start_program(instance);
+    // Exceptions can't pass through Godot's C callbacks.  Without a program
+    // the terminal stays empty and reports that it exited right away.
+    try {
+        return start_program(instance);
+    } catch (std::exception const& e) {
+        std::cerr << "Couldn't start a terminal: " << e.what() << '\n';
+    }
+
+    auto const term = new terminal_program{katerm::terminal{terminal_size}, -1, instance};
+    term->emit_exited(gd100::process_exit{-1, {}, {}, 0});
+    return term;
 }
 
 void destroy_terminal(godot_object* const instance, void* const method_data, void* user_data)
 {
-    auto term = reinterpret_cast<terminal_program*>(user_data);
+    auto term = reinterpret_cast<terminal_session*>(user_data);
+
+    if (auto const remote = dynamic_cast<remote_terminal*>(term)) {
+        remote->owner->close_terminal(remote);
+    } else if (term->master_descriptor < 0) {
+        // Made by create_terminal when no program could be started, it was
+        // never handed to the manager.
+        delete term;
+    } else {
+        // The controller may still hold the program after it's removed, it
+        // must not emit signals on the object that's being freed.
+        auto const program = static_cast<terminal_program*>(term);
+        program->detach();
+        manager.remove_program(program->master_descriptor);
+    }
+}
+
+godot_variant set_focused_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    if (num_args == 1) {
+        auto const focused = gdl::api->godot_variant_as_bool(args[0]);
+        auto term = reinterpret_cast<terminal_session*>(user_data);
+
+        if (auto const remote = dynamic_cast<remote_terminal*>(term))
+            host->set_focused(remote, focused);
+        else
+            manager.set_focused(term->master_descriptor, focused);
+    }
+
+    godot_variant ret;
+    gdl::api->godot_variant_new_nil(&ret);
+    return ret;
+}
+
+godot_variant set_predictive_echo_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    if (num_args == 1) {
+        auto term = reinterpret_cast<terminal_session*>(user_data);
+        term->set_predictive_echo(gdl::api->godot_variant_as_bool(args[0]));
+    }
+
+    godot_variant ret;
+    gdl::api->godot_variant_new_nil(&ret);
+    return ret;
+}
+
+godot_variant get_terminal_id_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    auto term = reinterpret_cast<terminal_session*>(user_data);
+
+    godot_variant ret;
+    gdl::api->godot_variant_new_int(&ret, term->terminal_id);
+    return ret;
+}
+
+void* create_hub(godot_object* const instance, void* const method_data)
+{
+    return new terminal_hub;
+}
+
+void destroy_hub(godot_object* const instance, void* const method_data, void* user_data)
+{
+    delete reinterpret_cast<terminal_hub*>(user_data);
+}
+
+godot_variant hub_add_terminal_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    if (num_args == 1) {
+        auto hub = reinterpret_cast<terminal_hub*>(user_data);
+        hub->add(gdl::api->godot_variant_as_int(args[0]));
+    }
+
+    godot_variant ret;
+    gdl::api->godot_variant_new_nil(&ret);
+    return ret;
+}
+
+godot_variant hub_remove_terminal_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    if (num_args == 1) {
+        auto hub = reinterpret_cast<terminal_hub*>(user_data);
+        hub->remove(gdl::api->godot_variant_as_int(args[0]));
+    }
+
+    godot_variant ret;
+    gdl::api->godot_variant_new_nil(&ret);
+    return ret;
+}
+
+godot_variant hub_collect_frames_method(
+        godot_object* const obj,
+        void* const method_data,
+        void* const user_data,
+        int const num_args,
+        godot_variant** const args)
+{
+    auto hub = reinterpret_cast<terminal_hub*>(user_data);
+    auto const span = gd100::trace_span{"collect-frames"};
+    return gdl::to_variant_handle(hub->collect_frames());
 }
 
 extern "C" {
@@ -482,18 +1716,10 @@ extern "C" {
 void GDTERM_EXPORT godot_gdnative_init(godot_gdnative_init_options* options)
 {
     gdl::initialise(options);
-
-    lines_key = gdl::string{"lines"};
-    cursor_key = gdl::string{"cursor"};
-    scroll_change_key = gdl::string{"scroll_change"};
 }
 
 void GDTERM_EXPORT godot_gdnative_terminate(godot_gdnative_terminate_options* options)
 {
-    scroll_change_key.reset();
-    cursor_key.reset();
-    lines_key.reset();
-
     gdl::deinitialise();
 }
 
@@ -531,6 +1757,36 @@ void GDTERM_EXPORT godot_nativescript_init(void* desc)
         "TerminalLogic",
         &signal);
 
+    godot_signal_argument exited_args[]{
+        {
+            gdl::api->godot_string_chars_to_utf8("code"),
+            GODOT_VARIANT_TYPE_INT,
+            GODOT_PROPERTY_HINT_NONE,
+            gdl::api->godot_string_chars_to_utf8("hint str"),
+            GODOT_PROPERTY_USAGE_DEFAULT,
+            nil
+        },
+        {
+            gdl::api->godot_string_chars_to_utf8("usage"),
+            GODOT_VARIANT_TYPE_DICTIONARY,
+            GODOT_PROPERTY_HINT_NONE,
+            gdl::api->godot_string_chars_to_utf8("hint str"),
+            GODOT_PROPERTY_USAGE_DEFAULT,
+            nil
+        },
+    };
+
+    auto const exited_signal = godot_signal{
+        gdl::api->godot_string_chars_to_utf8("exited"),
+        2, exited_args,
+        0, nullptr,
+    };
+
+    gdl::nativescript_api->godot_nativescript_register_signal(
+        desc,
+        "TerminalLogic",
+        &exited_signal);
+
     godot_method_attributes const attr{
         GODOT_METHOD_RPC_MODE_DISABLED
     };
@@ -558,6 +1814,171 @@ void GDTERM_EXPORT godot_nativescript_init(void* desc)
         "send_mouse",
         attr,
         sm_method);
+
+    auto const gt_method = godot_instance_method{
+        get_text_method,
+        nullptr, nullptr,
+    };
+
+    gdl::nativescript_api->godot_nativescript_register_method(
+        desc,
+        "TerminalLogic",
+        "get_text",
+        attr,
+        gt_method);
+
+    auto const glt_method = godot_instance_method{
+        get_line_text_method,
+        nullptr, nullptr,
+    };
+
+    gdl::nativescript_api->godot_nativescript_register_method(
+        desc,
+        "TerminalLogic",
+        "get_line_text",
+        attr,
+        glt_method);
+
+    auto const ss_method = godot_instance_method{
+        save_state_method,
+        nullptr, nullptr,
+    };
+
+    gdl::nativescript_api->godot_nativescript_register_method(
+        desc,
+        "TerminalLogic",
+        "save_state",
+        attr,
+        ss_method);
+
+    auto const ls_method = godot_instance_method{
+        load_state_method,
+        nullptr, nullptr,
+    };
+
+    gdl::nativescript_api->godot_nativescript_register_method(
+        desc,
+        "TerminalLogic",
+        "load_state",
+        attr,
+        ls_method);
+
+    auto const sp_method = godot_instance_method{
+        set_palette_method,
+        nullptr, nullptr,
+    };
+
+    gdl::nativescript_api->godot_nativescript_register_method(
+        desc,
+        "TerminalLogic",
+        "set_palette",
+        attr,
+        sp_method);
+
+    auto const sf_method = godot_instance_method{
+        set_focused_method,
+        nullptr, nullptr,
+    };
+
+    gdl::nativescript_api->godot_nativescript_register_method(
+        desc,
+        "TerminalLogic",
+        "set_focused",
+        attr,
+        sf_method);
+
+    auto const st_method = godot_instance_method{
+        set_tracing_method,
+        nullptr, nullptr,
+    };
+
+    gdl::nativescript_api->godot_nativescript_register_method(
+        desc,
+        "TerminalLogic",
+        "set_tracing",
+        attr,
+        st_method);
+
+    auto const wt_method = godot_instance_method{
+        write_trace_method,
+        nullptr, nullptr,
+    };
+
+    gdl::nativescript_api->godot_nativescript_register_method(
+        desc,
+        "TerminalLogic",
+        "write_trace",
+        attr,
+        wt_method);
+
+    auto const spe_method = godot_instance_method{
+        set_predictive_echo_method,
+        nullptr, nullptr,
+    };
+
+    gdl::nativescript_api->godot_nativescript_register_method(
+        desc,
+        "TerminalLogic",
+        "set_predictive_echo",
+        attr,
+        spe_method);
+
+    auto const gti_method = godot_instance_method{
+        get_terminal_id_method,
+        nullptr, nullptr,
+    };
+
+    gdl::nativescript_api->godot_nativescript_register_method(
+        desc,
+        "TerminalLogic",
+        "get_terminal_id",
+        attr,
+        gti_method);
+
+    auto const hub_create = godot_instance_create_func{create_hub, nullptr, nullptr};
+    auto const hub_destroy = godot_instance_destroy_func{destroy_hub, nullptr, nullptr};
+
+    gdl::nativescript_api->godot_nativescript_register_class(
+        desc,
+        "TerminalHub",
+        "Reference",
+        hub_create, hub_destroy);
+
+    auto const ha_method = godot_instance_method{
+        hub_add_terminal_method,
+        nullptr, nullptr,
+    };
+
+    gdl::nativescript_api->godot_nativescript_register_method(
+        desc,
+        "TerminalHub",
+        "add_terminal",
+        attr,
+        ha_method);
+
+    auto const hr_method = godot_instance_method{
+        hub_remove_terminal_method,
+        nullptr, nullptr,
+    };
+
+    gdl::nativescript_api->godot_nativescript_register_method(
+        desc,
+        "TerminalHub",
+        "remove_terminal",
+        attr,
+        hr_method);
+
+    auto const hc_method = godot_instance_method{
+        hub_collect_frames_method,
+        nullptr, nullptr,
+    };
+
+    gdl::nativescript_api->godot_nativescript_register_method(
+        desc,
+        "TerminalHub",
+        "collect_frames",
+        attr,
+        hc_method);
 }
 
 }
@@ -0,0 +1,880 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+#include "graphics_filter.hpp"
+#include "palette.hpp"
+
+namespace gd100 {
+
+namespace {
+
+// Larger images are dropped, sixels as soon as they grow past it.
+constexpr std::size_t max_image_bytes = 32 * 1024 * 1024;
+constexpr std::size_t cache_bytes = 64 * 1024 * 1024;
+
+// Only parameters and keys this long are looked at.
+constexpr std::size_t max_header_size = 64;
+constexpr std::size_t max_keys_size = 256;
+
+// Sixels and kitty images without an id get one from this range.
+constexpr std::uint32_t first_anonymous_id = 0x80000000;
+
+// 0xRRGGBBAA to a pixel that's stored as the bytes R, G, B and A.
+std::uint32_t to_pixel(std::uint32_t const rgba)
+{
+    unsigned char const bytes[]{
+        static_cast<unsigned char>(rgba >> 24),
+        static_cast<unsigned char>(rgba >> 16),
+        static_cast<unsigned char>(rgba >> 8),
+        static_cast<unsigned char>(rgba),
+    };
+
+    std::uint32_t ret;
+    std::memcpy(&ret, bytes, sizeof(ret));
+    return ret;
+}
+
+std::uint32_t from_percent(int const r, int const g, int const b)
+{
+    auto const channel = [](int const percent) {
+        return static_cast<std::uint32_t>(std::clamp(percent, 0, 100) * 255 / 100);
+    };
+
+    return channel(r) << 24 | channel(g) << 16 | channel(b) << 8 | 0xff;
+}
+
+// Sixel HLS has blue at 0 degrees, red at 120 and green at 240.
+std::uint32_t from_hls(int const h, int const l, int const s)
+{
+    auto const hue = ((h + 240) % 360) / 360.0;
+    auto const lightness = std::clamp(l, 0, 100) / 100.0;
+    auto const saturation = std::clamp(s, 0, 100) / 100.0;
+
+    if (saturation == 0) {
+        auto const grey = static_cast<int>(std::lround(lightness * 100));
+        return from_percent(grey, grey, grey);
+    }
+
+    auto const q = lightness < 0.5
+                   ? lightness * (1 + saturation)
+                   : lightness + saturation - lightness * saturation;
+    auto const p = 2 * lightness - q;
+
+    auto const channel = [&](double t) {
+        if (t < 0) t += 1;
+        if (t > 1) t -= 1;
+
+        double value = p;
+        if (t < 1.0 / 6) value = p + (q - p) * 6 * t;
+        else if (t < 1.0 / 2) value = q;
+        else if (t < 2.0 / 3) value = p + (q - p) * (2.0 / 3 - t) * 6;
+
+        return static_cast<int>(std::lround(value * 100));
+    };
+
+    return from_percent(channel(hue + 1.0 / 3), channel(hue), channel(hue - 1.0 / 3));
+}
+
+int base64_value(unsigned char const c)
+{
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+int parse_number(std::string_view const text)
+{
+    int ret = 0;
+    for (auto const c : text) {
+        if (c < '0' || c > '9')
+            break;
+
+        ret = std::min(ret * 10 + (c - '0'), 1'000'000'000);
+    }
+
+    return ret;
+}
+
+std::size_t image_size(image const& img)
+{
+    return sizeof(img) + img.data.size();
+}
+
+// Width and height from the IHDR chunk, which comes right after the
+// signature.  Zero when the data is too short to have one.
+std::pair<int, int> png_size(std::vector<char> const& data)
+{
+    constexpr std::size_t ihdr_end = 24;
+    if (data.size() < ihdr_end)
+        return {0, 0};
+
+    auto const read_u32 = [&](std::size_t const offset) {
+        std::uint32_t value = 0;
+        for (std::size_t i = 0; i != 4; ++i)
+            value = value << 8 | static_cast<unsigned char>(data[offset + i]);
+
+        return static_cast<int>(std::min<std::uint32_t>(value, 1'000'000));
+    };
+
+    return {read_u32(16), read_u32(20)};
+}
+
+} // ::
+
+image_cache::image_cache(std::size_t const l)
+    : limit{l}
+{
+}
+
+void image_cache::insert(std::shared_ptr<image const> img, std::vector<std::uint32_t>& evicted)
+{
+    erase(img->id);
+
+    size += image_size(*img);
+    entries.push_front(std::move(img));
+    by_id[entries.front()->id] = entries.begin();
+
+    // The newest image always stays, even when it's over the limit by itself.
+    while (size > limit && entries.size() > 1) {
+        auto const id = entries.back()->id;
+        evicted.push_back(id);
+        erase(id);
+    }
+}
+
+std::shared_ptr<image const> image_cache::find(std::uint32_t const id)
+{
+    auto const it = by_id.find(id);
+    if (it == by_id.end())
+        return nullptr;
+
+    entries.splice(entries.begin(), entries, it->second);
+    return entries.front();
+}
+
+void image_cache::erase(std::uint32_t const id)
+{
+    auto const it = by_id.find(id);
+    if (it == by_id.end())
+        return;
+
+    size -= image_size(**it->second);
+    entries.erase(it->second);
+    by_id.erase(it);
+}
+
+void image_cache::clear()
+{
+    entries.clear();
+    by_id.clear();
+    size = 0;
+}
+
+graphics_filter::graphics_filter()
+    : cache{cache_bytes}
+    , next_anonymous_id{first_anonymous_id}
+{
+}
+
+void graphics_filter::feed(
+        char const* const data,
+        std::size_t const size,
+        katerm::terminal& term,
+        tracking_decoder& decoder)
+{
+    current_terminal = &term;
+    current_decoder = &decoder;
+
+    auto pos = data;
+    auto const end = data + size;
+
+    while (pos != end) {
+        // Most output is plain text, hand everything up to the next escape
+        // to the decoder at once.
+        if (state == filter_state::ground) {
+            auto const escape = static_cast<char const*>(std::memchr(pos, '\x1b', end - pos));
+            auto const run_end = escape ? escape : end;
+
+            pass_through(pos, run_end - pos);
+            pos = run_end;
+
+            if (escape) {
+                state = filter_state::escape;
+                ++pos;
+            }
+
+            continue;
+        }
+
+        auto const byte = static_cast<unsigned char>(*pos++);
+
+        switch (state) {
+            case filter_state::ground:
+                break;
+
+            case filter_state::escape:
+                if (byte == 'P') {
+                    begin_sequence(filter_state::dcs_header);
+                } else if (byte == '_') {
+                    begin_sequence(filter_state::apc_start);
+                } else if (byte == 0x1b) {
+                    pass_through("\x1b", 1);
+                } else {
+                    char const sequence[]{'\x1b', static_cast<char>(byte)};
+                    pass_through(sequence, sizeof(sequence));
+                    state = filter_state::ground;
+                }
+                break;
+
+            case filter_state::dcs_header:
+                // Parameter and intermediate bytes.  Past max_header_size
+                // they're still consumed, only the final byte ends the header.
+                if (byte >= 0x20 && byte <= 0x3f) {
+                    if (byte <= 0x2f)
+                        header_intermediates = true;
+
+                    if (header.size() < max_header_size)
+                        header += static_cast<char>(byte);
+
+                    break;
+                }
+
+                // ESC, CAN and SUB cancel the sequence, the decoder is told
+                // what came before so it can do the same.
+                if (byte == 0x1b || byte == 0x18 || byte == 0x1a) {
+                    header.insert(0, "\x1bP");
+                    if (byte != 0x1b)
+                        header += static_cast<char>(byte);
+
+                    pass_through(header.data(), header.size());
+                    state = byte == 0x1b ? filter_state::escape : filter_state::ground;
+                    break;
+                }
+
+                // Other controls and DEL are ignored like in any DCS header.
+                if (byte < 0x40 || byte > 0x7e)
+                    break;
+
+                // Sixel is the only DCS without intermediate bytes that ends in q.
+                if (byte == 'q' && !header_intermediates) {
+                    start_sixel(header);
+                    state = filter_state::sixel;
+                } else {
+                    // A header that was cut short reaches the decoder without
+                    // the parameters past max_header_size.
+                    header.insert(0, "\x1bP");
+                    header += static_cast<char>(byte);
+                    pass_through(header.data(), header.size());
+                    state = filter_state::ground;
+                }
+                break;
+
+            case filter_state::apc_start:
+                if (byte == 'G') {
+                    state = filter_state::kitty_keys;
+                } else {
+                    char const sequence[]{'\x1b', '_', static_cast<char>(byte)};
+                    pass_through(sequence, sizeof(sequence));
+                    state = filter_state::ground;
+                }
+                break;
+
+            case filter_state::sixel:
+                if (byte == 0x1b) {
+                    string_state = state;
+                    state = filter_state::string_escape;
+                } else {
+                    sixel_byte(byte);
+                }
+                break;
+
+            case filter_state::kitty_keys:
+                if (byte == ';' || byte == 0x1b) {
+                    start_kitty(header);
+                    state = filter_state::kitty_payload;
+
+                    if (byte == 0x1b) {
+                        string_state = state;
+                        state = filter_state::string_escape;
+                    }
+                } else if (header.size() < max_keys_size) {
+                    header += static_cast<char>(byte);
+                }
+                break;
+
+            case filter_state::kitty_payload:
+                if (byte == 0x1b) {
+                    string_state = state;
+                    state = filter_state::string_escape;
+                } else {
+                    kitty_payload_byte(byte);
+                }
+                break;
+
+            case filter_state::string_escape:
+                if (byte == '\\') {
+                    end_sequence();
+                    state = filter_state::ground;
+                } else {
+                    // Some other sequence interrupted the image, which is
+                    // dropped.  The byte belongs to the new sequence.
+                    abort_sequence();
+                    state = filter_state::escape;
+                    --pos;
+                }
+                break;
+        }
+    }
+
+    current_terminal = nullptr;
+    current_decoder = nullptr;
+}
+
+void graphics_filter::take_updates(frame& f)
+{
+    f.deleted_images.insert(f.deleted_images.end(), deletions.begin(), deletions.end());
+    deletions.clear();
+
+    std::move(placements.begin(), placements.end(), std::back_inserter(f.images));
+    placements.clear();
+}
+
+void graphics_filter::restore_updates(frame& f)
+{
+    deletions.insert(deletions.begin(), f.deleted_images.begin(), f.deleted_images.end());
+    placements.insert(placements.begin(),
+                      std::make_move_iterator(f.images.begin()),
+                      std::make_move_iterator(f.images.end()));
+
+    f.deleted_images.clear();
+    f.images.clear();
+}
+
+std::string graphics_filter::take_responses()
+{
+    return std::exchange(responses, std::string{});
+}
+
+void graphics_filter::reset()
+{
+    cache.clear();
+    sent.clear();
+    placements.clear();
+    deletions.assign(1, 0);
+}
+
+void graphics_filter::pass_through(char const* const data, std::size_t const size)
+{
+    if (size == 0)
+        return;
+
+    katerm::terminal_instructee t{current_terminal};
+    current_decoder->decode(data, size, t);
+}
+
+void graphics_filter::begin_sequence(filter_state const next)
+{
+    header.clear();
+    header_intermediates = false;
+    state = next;
+}
+
+void graphics_filter::end_sequence()
+{
+    if (string_state == filter_state::sixel)
+        finish_sixel();
+    else
+        finish_kitty_chunk();
+}
+
+void graphics_filter::abort_sequence()
+{
+    if (string_state == filter_state::sixel) {
+        sixel.pixels = {};
+    } else {
+        kitty_loading = false;
+        kitty_image.reset();
+    }
+}
+
+void graphics_filter::start_sixel(std::string_view parameters)
+{
+    // The second parameter selects whether pixels that aren't drawn keep the
+    // background colour (0 or 2) or stay transparent (1).
+    auto const separator = parameters.find(';');
+    auto const background = separator == std::string_view::npos
+                            ? 0
+                            : parse_number(parameters.substr(separator + 1));
+
+    sixel = sixel_state{};
+    sixel.transparent_background = background == 1;
+    sixel.registers = default_palette;
+    sixel.colour = to_pixel(sixel.registers[0]);
+}
+
+void graphics_filter::sixel_byte(unsigned char const byte)
+{
+    if (sixel.command) {
+        if (byte >= '0' && byte <= '9') {
+            auto& parameter = sixel.parameters[sixel.parameter_count - 1];
+            parameter = std::min(parameter * 10 + (byte - '0'), 100'000);
+            return;
+        }
+
+        if (byte == ';') {
+            if (sixel.parameter_count < sixel.parameters.size())
+                sixel.parameters[sixel.parameter_count++] = 0;
+
+            return;
+        }
+
+        finish_sixel_command();
+    }
+
+    switch (byte) {
+        case '#':
+        case '"':
+        case '!':
+            sixel.command = static_cast<char>(byte);
+            sixel.parameters[0] = 0;
+            sixel.parameter_count = 1;
+            break;
+
+        case '$':
+            sixel.x = 0;
+            break;
+
+        case '-':
+            sixel.x = 0;
+            sixel.y += 6;
+            break;
+
+        default:
+            if (byte >= '?' && byte <= '~')
+                paint_sixel(byte - '?');
+            break;
+    }
+}
+
+void graphics_filter::finish_sixel_command()
+{
+    auto const& p = sixel.parameters;
+
+    switch (std::exchange(sixel.command, 0)) {
+        case '!':
+            sixel.repeat = std::max(1, p[0]);
+            break;
+
+        case '#': {
+            auto& reg = sixel.registers[p[0] % sixel.registers.size()];
+
+            if (sixel.parameter_count >= 5) {
+                if (p[1] == 1)
+                    reg = from_hls(p[2], p[3], p[4]);
+                else if (p[1] == 2)
+                    reg = from_percent(p[2], p[3], p[4]);
+            }
+
+            sixel.colour = to_pixel(reg);
+            break;
+        }
+
+        case '"':
+            if (sixel.parameter_count >= 4) {
+                sixel.declared_width = p[2];
+                sixel.declared_height = p[3];
+
+                if (!reserve_sixel(p[2], p[3]))
+                    sixel.failed = true;
+            }
+            break;
+    }
+}
+
+void graphics_filter::paint_sixel(unsigned const bits)
+{
+    auto const count = std::exchange(sixel.repeat, 1);
+    auto const x = sixel.x;
+    sixel.x = std::min(sixel.x + count, 1'000'000);
+
+    if (bits == 0 || sixel.failed)
+        return;
+
+    if (!reserve_sixel(x + count, sixel.y + 6)) {
+        sixel.failed = true;
+        return;
+    }
+
+    for (int bit = 0; bit != 6; ++bit) {
+        if (!(bits & 1u << bit))
+            continue;
+
+        auto const row = sixel.pixels.data() + static_cast<std::size_t>(sixel.y + bit) * sixel.stride;
+        std::fill_n(row + x, count, sixel.colour);
+        sixel.height = std::max(sixel.height, sixel.y + bit + 1);
+    }
+
+    sixel.width = std::max(sixel.width, x + count);
+}
+
+bool graphics_filter::reserve_sixel(int const width, int const height)
+{
+    if (width <= sixel.stride && height <= sixel.allocated_rows)
+        return true;
+
+    auto const fits = [](std::size_t const w, std::size_t const h) {
+        return w * h * sizeof(std::uint32_t) <= max_image_bytes;
+    };
+
+    if (!fits(width, height))
+        return false;
+
+    // Grow in steps so an image drawn band by band isn't copied for every band.
+    auto new_stride = std::max(width, sixel.stride);
+    auto new_rows = std::max(height, sixel.allocated_rows);
+
+    if (width > sixel.stride && fits(sixel.stride * 2, new_rows))
+        new_stride = std::max(new_stride, sixel.stride * 2);
+    if (height > sixel.allocated_rows && fits(new_stride, sixel.allocated_rows * 2))
+        new_rows = std::max(new_rows, sixel.allocated_rows * 2);
+
+    std::vector<std::uint32_t> pixels(static_cast<std::size_t>(new_stride) * new_rows, 0);
+    for (int row = 0; row != sixel.allocated_rows; ++row) {
+        std::copy_n(sixel.pixels.data() + static_cast<std::size_t>(row) * sixel.stride,
+                    sixel.stride,
+                    pixels.data() + static_cast<std::size_t>(row) * new_stride);
+    }
+
+    sixel.pixels = std::move(pixels);
+    sixel.stride = new_stride;
+    sixel.allocated_rows = new_rows;
+    return true;
+}
+
+void graphics_filter::finish_sixel()
+{
+    finish_sixel_command();
+
+    auto width = std::max(sixel.width, sixel.declared_width);
+    auto height = std::max(sixel.height, sixel.declared_height);
+
+    if (sixel.failed || !reserve_sixel(width, height) || width == 0 || height == 0) {
+        sixel.pixels = {};
+        return;
+    }
+
+    if (!sixel.transparent_background) {
+        auto const background = to_pixel(sixel.registers[0]);
+        std::replace(sixel.pixels.begin(), sixel.pixels.end(), std::uint32_t{0}, background);
+    }
+
+    auto img = std::make_shared<image>();
+    img->id = next_anonymous_id++;
+    img->width = width;
+    img->height = height;
+    img->data.resize(static_cast<std::size_t>(width) * height * sizeof(std::uint32_t));
+
+    auto const row_bytes = static_cast<std::size_t>(width) * sizeof(std::uint32_t);
+    for (int row = 0; row != height; ++row) {
+        std::memcpy(img->data.data() + row * row_bytes,
+                    sixel.pixels.data() + static_cast<std::size_t>(row) * sixel.stride,
+                    row_bytes);
+    }
+
+    sixel.pixels = {};
+
+    if (next_anonymous_id == 0)
+        next_anonymous_id = first_anonymous_id;
+
+    store(std::move(img), true, cursor_movement::below);
+}
+
+void graphics_filter::start_kitty(std::string_view keys)
+{
+    // Keys are comma separated key=value pairs, the values are numbers or
+    // single characters.
+    kitty_command command;
+    if (kitty_loading)
+        command = kitty;
+
+    while (!keys.empty()) {
+        auto const comma = keys.find(',');
+        auto const pair = keys.substr(0, comma);
+        keys.remove_prefix(comma == std::string_view::npos ? keys.size() : comma + 1);
+
+        if (pair.size() < 3 || pair[1] != '=')
+            continue;
+
+        auto const value = pair.substr(2);
+
+        // The chunks after the first only carry m and q.
+        if (kitty_loading && pair[0] != 'm' && pair[0] != 'q')
+            continue;
+
+        switch (pair[0]) {
+            case 'a': command.action = value[0]; break;
+            case 't': command.medium = value[0]; break;
+            case 'd': command.deletion = value[0]; break;
+            case 'o': command.compression = value[0]; break;
+            case 'f': command.format = parse_number(value); break;
+            case 'i': command.id = static_cast<std::uint32_t>(parse_number(value)); break;
+            case 's': command.width = parse_number(value); break;
+            case 'v': command.height = parse_number(value); break;
+            case 'q': command.quiet = parse_number(value); break;
+            case 'm': command.more = parse_number(value) == 1; break;
+            case 'C': command.keep_cursor = parse_number(value) == 1; break;
+        }
+    }
+
+    kitty = command;
+    header.clear();
+
+    if (kitty_loading)
+        return;
+
+    kitty_image.reset();
+    kitty_error = nullptr;
+    base64_bits = 0;
+    base64_count = 0;
+    rgb_count = 0;
+
+    if (kitty.action != 't' && kitty.action != 'T' && kitty.action != 'q')
+        return;
+
+    if (kitty.medium != 'd') {
+        kitty_error = "EINVAL:only direct transmission is supported";
+    } else if (kitty.compression) {
+        kitty_error = "EINVAL:compression is not supported";
+    } else if (kitty.format != 24 && kitty.format != 32 && kitty.format != 100) {
+        kitty_error = "EINVAL:unknown format";
+    } else if (kitty.format != 100
+               && static_cast<std::size_t>(kitty.width) * kitty.height * 4 > max_image_bytes) {
+        kitty_error = "EFBIG:image too large";
+    } else {
+        kitty_image = std::make_shared<image>();
+        kitty_image->width = kitty.format == 100 ? 0 : kitty.width;
+        kitty_image->height = kitty.format == 100 ? 0 : kitty.height;
+        kitty_image->format = kitty.format == 100 ? image_format::png : image_format::rgba;
+
+        if (kitty.format != 100)
+            kitty_image->data.reserve(static_cast<std::size_t>(kitty.width) * kitty.height * 4);
+    }
+}
+
+void graphics_filter::kitty_payload_byte(unsigned char const byte)
+{
+    if (!kitty_image)
+        return;
+
+    // Padding and anything else that isn't base64 is skipped, leftover bits
+    // at the end are dropped.
+    auto const value = base64_value(byte);
+    if (value < 0)
+        return;
+
+    base64_bits = base64_bits << 6 | static_cast<std::uint32_t>(value);
+    base64_count += 6;
+
+    if (base64_count >= 8) {
+        base64_count -= 8;
+        kitty_data(static_cast<unsigned char>(base64_bits >> base64_count));
+    }
+}
+
+void graphics_filter::kitty_data(unsigned char const byte)
+{
+    auto& data = kitty_image->data;
+
+    if (data.size() + 4 > max_image_bytes) {
+        kitty_error = "EFBIG:image too large";
+        kitty_image.reset();
+        return;
+    }
+
+    if (kitty.format != 24) {
+        data.push_back(static_cast<char>(byte));
+        return;
+    }
+
+    rgb[rgb_count++] = byte;
+    if (rgb_count == 3) {
+        data.insert(data.end(), {
+            static_cast<char>(rgb[0]),
+            static_cast<char>(rgb[1]),
+            static_cast<char>(rgb[2]),
+            static_cast<char>(0xff),
+        });
+
+        rgb_count = 0;
+    }
+}
+
+void graphics_filter::finish_kitty_chunk()
+{
+    kitty_loading = kitty.more;
+    if (!kitty_loading)
+        finish_kitty();
+}
+
+void graphics_filter::finish_kitty()
+{
+    auto img = std::move(kitty_image);
+
+    switch (kitty.action) {
+        case 'd':
+            // Lower case only removes the placements, upper case frees the
+            // image data as well.  The receiver drops the pixels either way,
+            // so an image that's kept is sent again with its next placement.
+            if (kitty.deletion == 'a' || kitty.deletion == 'A') {
+                if (kitty.deletion == 'A')
+                    cache.clear();
+
+                sent.clear();
+                placements.clear();
+                deletions.push_back(0);
+            } else if ((kitty.deletion == 'i' || kitty.deletion == 'I') && kitty.id != 0) {
+                if (kitty.deletion == 'I')
+                    cache.erase(kitty.id);
+
+                sent.erase(kitty.id);
+                placements.erase(
+                    std::remove_if(placements.begin(), placements.end(),
+                                   [&](auto const& p) { return p.id == kitty.id; }),
+                    placements.end());
+                deletions.push_back(kitty.id);
+            }
+            return;
+
+        case 'p':
+            if (!cache.find(kitty.id)) {
+                respond(kitty.id, kitty.quiet, "ENOENT:no such image");
+                return;
+            }
+
+            place(kitty.id, kitty.keep_cursor ? cursor_movement::stay : cursor_movement::after);
+            respond(kitty.id, kitty.quiet, nullptr);
+            return;
+
+        case 't':
+        case 'T':
+        case 'q':
+            break;
+
+        default:
+            respond(kitty.id, kitty.quiet, "EINVAL:unknown action");
+            return;
+    }
+
+    if (!kitty_error && img) {
+        auto const expected = static_cast<std::size_t>(img->width) * img->height * 4;
+        if (img->format == image_format::rgba && (expected == 0 || img->data.size() != expected))
+            kitty_error = "EINVAL:image data doesn't match its size";
+        else if (img->data.empty())
+            kitty_error = "EINVAL:no image data";
+    }
+
+    respond(kitty.id, kitty.quiet, kitty_error);
+
+    if (kitty_error || !img || kitty.action == 'q')
+        return;
+
+    // Without an id a transmitted image could never be shown.
+    if (kitty.id == 0 && kitty.action == 't')
+        return;
+
+    img->id = kitty.id;
+    if (img->id == 0) {
+        img->id = next_anonymous_id++;
+        if (next_anonymous_id == 0)
+            next_anonymous_id = first_anonymous_id;
+    }
+
+    store(std::move(img), kitty.action == 'T',
+          kitty.keep_cursor ? cursor_movement::stay : cursor_movement::after);
+}
+
+void graphics_filter::respond(std::uint32_t const id, int const quiet, char const* const error)
+{
+    // Kitty only replies to commands with an id, q=1 leaves out the OKs and
+    // q=2 the errors too.
+    if (id == 0 || quiet >= 2 || (quiet == 1 && !error))
+        return;
+
+    responses += "\x1b_Gi=";
+    responses += std::to_string(id);
+    responses += ';';
+    responses += error ? error : "OK";
+    responses += "\x1b\\";
+}
+
+void graphics_filter::store(
+        std::shared_ptr<image> img,
+        bool const place_now,
+        cursor_movement const movement)
+{
+    auto const id = img->id;
+    sent.erase(id);
+
+    std::vector<std::uint32_t> evicted;
+    cache.insert(std::move(img), evicted);
+
+    for (auto const e : evicted) {
+        sent.erase(e);
+        deletions.push_back(e);
+    }
+
+    if (place_now)
+        place(id, movement);
+}
+
+void graphics_filter::place(std::uint32_t const id, cursor_movement const movement)
+{
+    auto const img = cache.find(id);
+    auto const pos = current_terminal->cursor.pos;
+
+    // Only the first placement carries the pixels, the receiver keeps them.
+    auto const first = sent.insert(id).second;
+    placements.push_back({id, pos.x, pos.y, first ? img : nullptr});
+
+    move_cursor_past(*img, movement);
+}
+
+// Moves the cursor with line feeds and CHA through the decoder, so reaching
+// the bottom scrolls like it does for text.
+void graphics_filter::move_cursor_past(image const& img, cursor_movement const movement)
+{
+    if (movement == cursor_movement::stay)
+        return;
+
+    auto const [width, height] = img.format == image_format::png
+                                 ? png_size(img.data)
+                                 : std::pair{img.width, img.height};
+
+    if (width <= 0 || height <= 0)
+        return;
+
+    auto const columns = (width + assumed_cell_width - 1) / assumed_cell_width;
+    auto const rows = (height + assumed_cell_height - 1) / assumed_cell_height;
+    auto const start_column = current_terminal->cursor.pos.x;
+
+    // More than a screen of them has scrolled everything out already.
+    auto const line_feeds = std::min(movement == cursor_movement::below ? rows : rows - 1,
+                                     current_terminal->screen.size().height);
+    auto const column = movement == cursor_movement::below ? start_column : start_column + columns;
+
+    // CHA stops at the right edge by itself.
+    std::string moves(static_cast<std::size_t>(line_feeds), '\n');
+    moves += "\x1b[";
+    moves += std::to_string(column + 1);
+    moves += 'G';
+
+    pass_through(moves.data(), moves.size());
+}
+
+} // gd100::
@@ -0,0 +1,188 @@
+#ifndef GDTERM_GRAPHICS_FILTER_HPP
+#define GDTERM_GRAPHICS_FILTER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <katerm/terminal.hpp>
+
+#include "tracking_decoder.hpp"
+#include "frame_encoder.hpp"
+#include "image.hpp"
+
+namespace gd100 {
+
+// Completed images by id.  Once their total size goes over the limit the
+// least recently used ones are dropped.
+class image_cache {
+public:
+    explicit image_cache(std::size_t limit);
+
+    // Replaces an image with the same id.  Ids of images that had to make
+    // room are appended to evicted.
+    void insert(std::shared_ptr<image const> img, std::vector<std::uint32_t>& evicted);
+
+    std::shared_ptr<image const> find(std::uint32_t id);
+    void erase(std::uint32_t id);
+    void clear();
+
+private:
+    using entry_list = std::list<std::shared_ptr<image const>>;
+
+    std::size_t limit;
+    std::size_t size = 0;
+    entry_list entries; // most recently used first
+    std::unordered_map<std::uint32_t, entry_list::iterator> by_id;
+};
+
+// Takes sixel (DCS ... q) and kitty graphics (APC G) sequences out of a
+// program's output before it reaches the decoder.  Image data is decoded as
+// the bytes come in, so a large image is never buffered as text and doesn't
+// hold up the output around it.
+//
+// Images are placed at the cursor position the moment they complete.  Text
+// isn't moved out of the way, the receiver draws images over the cells.  The
+// cursor is moved past the image like other terminals do, which needs its
+// size in cells: the font isn't known here, so cells are taken to be
+// assumed_cell_width by assumed_cell_height pixels.
+class graphics_filter {
+public:
+    // The VT340's cell size, which sixel images are usually made for.
+    static constexpr int assumed_cell_width = 10;
+    static constexpr int assumed_cell_height = 20;
+
+    graphics_filter();
+
+    // Decodes everything that isn't a graphics sequence with decoder.
+    void feed(char const* data, std::size_t size, katerm::terminal& term, tracking_decoder& decoder);
+
+    // Moves the placements and deletions since the last call into f.
+    void take_updates(frame& f);
+
+    // Puts the updates of a frame that couldn't be delivered back, in front
+    // of the ones that came after it.
+    void restore_updates(frame& f);
+
+    // Replies to kitty graphics commands, to be written to the program.
+    std::string take_responses();
+
+    // Forgets every image, the receiver is told to drop them too.
+    void reset();
+
+private:
+    enum class filter_state {
+        ground,
+        escape,        // ESC in the ground state
+        dcs_header,    // ESC P, parameters up to the final byte
+        apc_start,     // ESC _, the next byte tells whether it's kitty graphics
+        sixel,
+        kitty_keys,
+        kitty_payload,
+        string_escape, // ESC inside a graphics sequence, expecting ST
+    };
+
+    struct sixel_state {
+        std::vector<std::uint32_t> pixels; // stride * allocated_rows
+        int stride = 0;
+        int allocated_rows = 0;
+        int declared_width = 0;
+        int declared_height = 0;
+        int width = 0;  // extent of what's been drawn
+        int height = 0;
+        int x = 0;
+        int y = 0;      // top of the current band of six rows
+        int repeat = 1;
+        std::uint32_t colour = 0;
+        bool transparent_background = false;
+        bool failed = false;
+        std::array<std::uint32_t, 256> registers;
+
+        char command = 0; // '#', '"' or '!' while its parameters come in
+        std::array<int, 5> parameters;
+        std::size_t parameter_count = 0;
+    };
+
+    struct kitty_command {
+        char action = 't';
+        char medium = 'd';
+        char deletion = 'a';
+        char compression = 0;
+        int format = 32;
+        std::uint32_t id = 0;
+        int width = 0;
+        int height = 0;
+        int quiet = 0;
+        bool more = false;
+        bool keep_cursor = false; // C=1
+    };
+
+    // Where the cursor goes after an image is placed.
+    enum class cursor_movement {
+        below,      // sixel: first row under the image, same column
+        after,      // kitty: last row of the image, column after it
+        stay,
+    };
+
+    void pass_through(char const* data, std::size_t size);
+    void begin_sequence(filter_state next);
+    void end_sequence();
+    void abort_sequence();
+
+    void start_sixel(std::string_view parameters);
+    void sixel_byte(unsigned char byte);
+    void finish_sixel_command();
+    void paint_sixel(unsigned bits);
+    bool reserve_sixel(int width, int height);
+    void finish_sixel();
+
+    void start_kitty(std::string_view keys);
+    void kitty_payload_byte(unsigned char byte);
+    void kitty_data(unsigned char byte);
+    void finish_kitty_chunk();
+    void finish_kitty();
+    void respond(std::uint32_t id, int quiet, char const* error);
+
+    void store(std::shared_ptr<image> img, bool place, cursor_movement movement);
+    void place(std::uint32_t id, cursor_movement movement);
+    void move_cursor_past(image const& img, cursor_movement movement);
+
+    filter_state state = filter_state::ground;
+    filter_state string_state = filter_state::ground; // state the ESC interrupted
+    std::string header;
+    bool header_intermediates = false; // A DCS header had bytes in 0x20-0x2f
+
+    // Where pass_through sends output, set for the duration of feed.
+    katerm::terminal* current_terminal = nullptr;
+    tracking_decoder* current_decoder = nullptr;
+
+    sixel_state sixel;
+
+    kitty_command kitty;
+    bool kitty_loading = false; // more chunks of kitty's image follow
+    std::shared_ptr<image> kitty_image;
+    char const* kitty_error = nullptr;
+    std::uint32_t base64_bits = 0;
+    int base64_count = 0;
+    std::array<unsigned char, 3> rgb{};
+    int rgb_count = 0;
+
+    image_cache cache;
+    std::unordered_set<std::uint32_t> sent;
+    std::uint32_t next_anonymous_id;
+
+    std::vector<image_placement> placements;
+    std::vector<std::uint32_t> deletions;
+    std::string responses;
+};
+
+} // gd100::
+
+#endif // header guard
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "host_protocol.hpp"
+
+namespace gd100 {
+
+bool send_message(
+        int const socket,
+        void const* const data,
+        std::size_t const size,
+        int const* const descriptors,
+        std::size_t const descriptor_count)
+{
+    if (descriptor_count > max_descriptors)
+        return false;
+
+    iovec iov{const_cast<void*>(data), size};
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * max_descriptors)]{};
+
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+
+    if (descriptor_count) {
+        message.msg_control = control;
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * descriptor_count);
+
+        auto const cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * descriptor_count);
+        std::memcpy(CMSG_DATA(cmsg), descriptors, sizeof(int) * descriptor_count);
+    }
+
+    return sendmsg(socket, &message, MSG_NOSIGNAL) == static_cast<ssize_t>(size);
+}
+
+bool receive_message(
+        int const socket,
+        void* const data,
+        std::size_t const size,
+        int* const descriptors,
+        std::size_t const descriptor_count)
+{
+    std::fill_n(descriptors, descriptor_count, -1);
+
+    iovec iov{data, size};
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * max_descriptors)]{};
+
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    auto const received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+
+    std::size_t stored = 0;
+    for (auto cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        auto const count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (std::size_t i = 0; i != count; ++i) {
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+
+            // Don't leak descriptors the caller has no room for.
+            if (stored != descriptor_count)
+                descriptors[stored++] = fd;
+            else
+                close(fd);
+        }
+    }
+
+    return received == static_cast<ssize_t>(size);
+}
+
+} // gd100::
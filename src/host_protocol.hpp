@@ -0,0 +1,72 @@
+#ifndef GDTERM_HOST_PROTOCOL_HPP
+#define GDTERM_HOST_PROTOCOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Communication between the Godot module and the out-of-process terminal
+// host (gd100-terminal-host).
+//
+// The module starts the host with one end of a SOCK_SEQPACKET socket pair as
+// file descriptor host_control_descriptor.  Requests and replies go over that
+// socket; frames and exit notifications are published by the host in a
+// frame_ring, with an eventfd that's signalled whenever records are added.
+// The descriptors for both are sent with the hello message.
+//
+// Input doesn't pass through the host, the module receives the pseudoterminal
+// master descriptor on spawn and writes to it directly.
+
+namespace gd100 {
+
+constexpr int host_control_descriptor = 3;
+constexpr std::uint32_t host_protocol_version = 3;
+
+// Sent by the host once at startup with the ring memfd and eventfd attached.
+struct host_hello {
+    std::uint32_t version;
+};
+
+enum class host_request_type : std::uint32_t {
+    spawn = 1,
+    close = 2,
+    focus = 3,
+    redraw = 4,
+};
+
+// For focus requests width is 1 to focus the terminal and 0 to unfocus it.
+// A redraw request makes the host send the terminal's whole screen with the
+// next frame and drop its images, the module lost frames it had.
+struct host_request {
+    host_request_type type;
+    std::uint32_t terminal;
+    std::int32_t width;
+    std::int32_t height;
+};
+
+// Reply to spawn, with the pseudoterminal master attached on success.
+struct host_spawn_reply {
+    std::uint32_t terminal;
+    std::int32_t pid; // -1 on failure
+};
+
+// Kinds of records in the frame ring.  Every record starts with the
+// terminal id (std::uint32_t) followed by the frame_wire encoding.
+enum class host_record_kind : std::uint32_t {
+    frame = 1,
+    exit = 2,
+};
+
+constexpr std::size_t max_descriptors = 4;
+
+// Sends a message with up to max_descriptors file descriptors attached.
+bool send_message(int socket, void const* data, std::size_t size,
+                  int const* descriptors, std::size_t descriptor_count);
+
+// Receives a message of exactly size bytes.  Attached descriptors are stored
+// in descriptors, unused entries are set to -1.
+bool receive_message(int socket, void* data, std::size_t size,
+                     int* descriptors, std::size_t descriptor_count);
+
+} // gd100::
+
+#endif // header guard
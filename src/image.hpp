@@ -0,0 +1,35 @@
+#ifndef GDTERM_IMAGE_HPP
+#define GDTERM_IMAGE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace gd100 {
+
+enum class image_format : std::uint8_t {
+    rgba = 0, // 8 bits per channel, rows from top to bottom
+    png = 1,  // the PNG file as the program sent it
+};
+
+// A complete image from a sixel or kitty graphics sequence.
+struct image {
+    std::uint32_t id = 0;
+    int width = 0;  // pixels, 0 for PNG images
+    int height = 0;
+    image_format format = image_format::rgba;
+    std::vector<char> data;
+};
+
+// An image shown with its top left corner at a cell.  data is only set the
+// first time the image is placed, after that the receiver still has it.
+struct image_placement {
+    std::uint32_t id;
+    int column;
+    int row;
+    std::shared_ptr<image const> data;
+};
+
+} // gd100::
+
+#endif // header guard
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <utility>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "io_uring_queue.hpp"
+
+namespace gd100 {
+
+namespace {
+
+template<class T>
+T* at_offset(void* const base, std::uint32_t const offset)
+{
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+} // ::
+
+std::optional<io_uring_queue> io_uring_queue::create(unsigned const entries)
+{
+    io_uring_params params{};
+    auto const fd = static_cast<int>(syscall(SYS_io_uring_setup, entries, &params));
+    if (fd < 0)
+        return std::nullopt;
+
+    io_uring_queue ret;
+    ret.ring_descriptor = fd;
+
+    // The timeout argument of io_uring_enter needs EXT_ARG.
+    constexpr auto required_features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required_features) != required_features)
+        return std::nullopt;
+
+    ret.sq_mapping_size = std::max(
+        params.sq_off.array + params.sq_entries * sizeof(unsigned),
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+
+    ret.sq_mapping = mmap(nullptr, ret.sq_mapping_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ret.sq_mapping == MAP_FAILED) {
+        ret.sq_mapping = nullptr;
+        return std::nullopt;
+    }
+
+    // With SINGLE_MMAP both rings live in the same mapping.
+    ret.cq_mapping = ret.sq_mapping;
+
+    ret.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    auto const sqes = mmap(nullptr, ret.sqes_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+        return std::nullopt;
+
+    ret.sqes = static_cast<io_uring_sqe*>(sqes);
+
+    ret.sq_head = at_offset<std::atomic<unsigned>>(ret.sq_mapping, params.sq_off.head);
+    ret.sq_tail = at_offset<std::atomic<unsigned>>(ret.sq_mapping, params.sq_off.tail);
+    ret.sq_mask = *at_offset<unsigned>(ret.sq_mapping, params.sq_off.ring_mask);
+    ret.sq_entries = params.sq_entries;
+    ret.sq_array = at_offset<unsigned>(ret.sq_mapping, params.sq_off.array);
+    ret.sqe_tail = ret.sq_tail->load(std::memory_order_relaxed);
+
+    ret.cq_head = at_offset<std::atomic<unsigned>>(ret.cq_mapping, params.cq_off.head);
+    ret.cq_tail = at_offset<std::atomic<unsigned>>(ret.cq_mapping, params.cq_off.tail);
+    ret.cq_mask = *at_offset<unsigned>(ret.cq_mapping, params.cq_off.ring_mask);
+    ret.cqes = at_offset<io_uring_cqe>(ret.cq_mapping, params.cq_off.cqes);
+
+    return ret;
+}
+
+io_uring_queue::io_uring_queue(io_uring_queue&& other) noexcept
+    : ring_descriptor{std::exchange(other.ring_descriptor, -1)}
+    , sq_mapping{std::exchange(other.sq_mapping, nullptr)}
+    , sq_mapping_size{other.sq_mapping_size}
+    , cq_mapping{std::exchange(other.cq_mapping, nullptr)}
+    , sqes{std::exchange(other.sqes, nullptr)}
+    , sqes_size{other.sqes_size}
+    , sq_head{other.sq_head}
+    , sq_tail{other.sq_tail}
+    , sq_mask{other.sq_mask}
+    , sq_entries{other.sq_entries}
+    , sq_array{other.sq_array}
+    , sqe_tail{other.sqe_tail}
+    , cq_head{other.cq_head}
+    , cq_tail{other.cq_tail}
+    , cq_mask{other.cq_mask}
+    , cqes{other.cqes}
+{
+}
+
+io_uring_queue::~io_uring_queue()
+{
+    if (sqes)
+        munmap(sqes, sqes_size);
+
+    if (sq_mapping)
+        munmap(sq_mapping, sq_mapping_size);
+
+    if (ring_descriptor >= 0)
+        close(ring_descriptor);
+}
+
+io_uring_sqe* io_uring_queue::get_sqe()
+{
+    auto const head = sq_head->load(std::memory_order_acquire);
+    if (sqe_tail - head >= sq_entries)
+        return nullptr;
+
+    auto const index = sqe_tail & sq_mask;
+    auto const sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+
+    sq_array[index] = index;
+    ++sqe_tail;
+
+    return sqe;
+}
+
+int io_uring_queue::submit()
+{
+    auto const to_submit = sqe_tail - sq_tail->load(std::memory_order_relaxed);
+    if (to_submit == 0)
+        return 0;
+
+    sq_tail->store(sqe_tail, std::memory_order_release);
+
+    return static_cast<int>(syscall(SYS_io_uring_enter, ring_descriptor, to_submit, 0, 0, nullptr, 0));
+}
+
+int io_uring_queue::wait(
+        unsigned const wait_count,
+        std::optional<std::chrono::nanoseconds> const timeout)
+{
+    __kernel_timespec ts{};
+    io_uring_getevents_arg arg{};
+    arg.sigmask_sz = _NSIG / 8;
+
+    if (timeout) {
+        ts.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(*timeout).count();
+        ts.tv_nsec = (*timeout % std::chrono::seconds{1}).count();
+        arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+    }
+
+    auto const result = syscall(SYS_io_uring_enter, ring_descriptor, 0, wait_count,
+                                IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                                &arg, sizeof(arg));
+
+    return static_cast<int>(result);
+}
+
+bool io_uring_queue::register_buffers(iovec const* const buffers, unsigned const count)
+{
+    return syscall(SYS_io_uring_register, ring_descriptor,
+                   IORING_REGISTER_BUFFERS, buffers, count) == 0;
+}
+
+} // gd100::
@@ -0,0 +1,91 @@
+#ifndef GDTERM_IO_URING_QUEUE_HPP
+#define GDTERM_IO_URING_QUEUE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+namespace gd100 {
+
+// Minimal io_uring wrapper on top of the raw system calls, only covering what
+// program_terminal_manager needs.
+//
+// Submission queue entries are prepared with get_sqe and are handed to the
+// kernel by the next submit call.  Not thread safe, callers serialise access.
+class io_uring_queue {
+public:
+    // Returns nothing when io_uring isn't available or lacks a feature we
+    // depend on (kernel 5.11 or newer is needed).
+    static std::optional<io_uring_queue> create(unsigned entries);
+
+    io_uring_queue(io_uring_queue&& other) noexcept;
+    io_uring_queue& operator=(io_uring_queue&&) = delete;
+    ~io_uring_queue();
+
+    // nullptr when the submission queue is full, submit first in that case.
+    io_uring_sqe* get_sqe();
+
+    // Hands all prepared entries to the kernel.
+    int submit();
+
+    // Waits until at least wait_count completions are available or the
+    // timeout expires.  Doesn't touch the submission queue so it can be
+    // called while another thread prepares and submits entries.
+    int wait(unsigned wait_count, std::optional<std::chrono::nanoseconds> timeout);
+
+    bool register_buffers(iovec const* buffers, unsigned count);
+
+    // Calls f(cqe) for every available completion.
+    template<class F>
+    unsigned for_each_completion(F&& f);
+
+private:
+    io_uring_queue() = default;
+
+    int ring_descriptor = -1;
+
+    void* sq_mapping = nullptr;
+    std::size_t sq_mapping_size = 0;
+    void* cq_mapping = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    std::size_t sqes_size = 0;
+
+    std::atomic<unsigned>* sq_head = nullptr;
+    std::atomic<unsigned>* sq_tail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned* sq_array = nullptr;
+    unsigned sqe_tail = 0;
+
+    std::atomic<unsigned>* cq_head = nullptr;
+    std::atomic<unsigned>* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+};
+
+template<class F>
+unsigned io_uring_queue::for_each_completion(F&& f)
+{
+    auto head = cq_head->load(std::memory_order_relaxed);
+    auto const tail = cq_tail->load(std::memory_order_acquire);
+
+    unsigned count = 0;
+    for (; head != tail; ++head, ++count) {
+        // Copy so the slot can be released before f runs, f might submit
+        // more work.
+        auto const cqe = cqes[head & cq_mask];
+        cq_head->store(head + 1, std::memory_order_release);
+        f(cqe);
+    }
+
+    return count;
+}
+
+} // gd100::
+
+#endif // header guard
@@ -0,0 +1,77 @@
+#include "local_echo.hpp"
+#include "unicode_width.hpp"
+
+namespace gd100 {
+
+bool local_echo::is_predictable(katerm::code_point const code)
+{
+    if (code < 0x20 || (code >= 0x7f && code < 0xa0))
+        return false;
+
+    // Wide and combining characters depend too much on the font and the
+    // program to guess where they end up.
+    return code_point_width(code) == 1;
+}
+
+bool local_echo::set_enabled(bool const e)
+{
+    enabled = e;
+    start_epoch();
+    return update_overlay();
+}
+
+bool local_echo::expire(clock::time_point const now)
+{
+    if (now < deadline())
+        return false;
+
+    start_epoch();
+    return update_overlay();
+}
+
+local_echo::verdict local_echo::judge(
+        prediction const& p,
+        katerm::position const cursor,
+        long const code,
+        clock::time_point const now) const
+{
+    // Writing the character over itself changes nothing, then only the
+    // cursor moving on along the row tells it was echoed.
+    auto const moved_on = cursor.y == p.row && cursor.x > p.column;
+    if (code == static_cast<long>(p.code) && (code != p.previous || moved_on))
+        return verdict::echoed;
+
+    // The cursor went past the cell without the character ending up there.
+    auto const passed = cursor.y != p.row || cursor.x > p.column;
+    if ((code >= 0 && passed) || now - p.made >= echo_timeout)
+        return verdict::wrong;
+
+    return verdict::waiting;
+}
+
+void local_echo::start_epoch()
+{
+    confirmed = false;
+    pending.clear();
+}
+
+bool local_echo::update_overlay()
+{
+    next_shown.clear();
+
+    if (confirmed) {
+        for (auto const& p : pending) {
+            next_shown.push_back(p.column);
+            next_shown.push_back(p.row);
+            next_shown.push_back(static_cast<std::int32_t>(p.code));
+        }
+    }
+
+    if (next_shown == shown)
+        return false;
+
+    shown.swap(next_shown);
+    return true;
+}
+
+} // gd100::
@@ -0,0 +1,150 @@
+#ifndef GDTERM_LOCAL_ECHO_HPP
+#define GDTERM_LOCAL_ECHO_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <katerm/terminal.hpp>
+
+namespace gd100 {
+
+// Guesses how typed characters will be echoed so they can be drawn before the
+// program gets around to it, like mosh does.
+//
+// Predictions come in epochs.  A new epoch starts with any key that isn't a
+// plain printable character (Enter, Backspace, arrow keys) and whenever a
+// guess turns out wrong.  Nothing is shown until the program has echoed one
+// character of the current epoch, so a password prompt never shows up in the
+// overlay.
+class local_echo {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // A prediction the program hasn't echoed within this time is wrong.
+    static constexpr auto echo_timeout = std::chrono::seconds{1};
+
+    // Returns whether the overlay changed.
+    bool set_enabled(bool enabled);
+
+    // cell(column, row) returns the code point at a position, or -1 when it
+    // isn't known.  Returns whether the overlay changed.
+    template<class CellLookup>
+    bool typed(katerm::code_point code, katerm::position cursor, int width,
+               CellLookup const& cell, clock::time_point now);
+
+    // Checks the predictions against the screen after decoding, cell is the
+    // same as for typed.  Returns whether the overlay changed.
+    template<class CellLookup>
+    bool reconcile(katerm::position cursor, CellLookup const& cell, clock::time_point now);
+
+    // When the oldest prediction times out, the owner calls expire then so
+    // the overlay doesn't stay up while the program is silent.  max when
+    // nothing is pending.
+    clock::time_point deadline() const noexcept
+    {
+        return pending.empty() ? clock::time_point::max() : pending.front().made + echo_timeout;
+    }
+
+    // Starts a new epoch if the deadline passed, returns whether the overlay
+    // changed.
+    bool expire(clock::time_point now);
+
+    // Column, row and code point of every prediction to draw.
+    std::vector<std::int32_t> const& overlay() const noexcept
+    {
+        return shown;
+    }
+
+private:
+    struct prediction {
+        int column;
+        int row;
+        katerm::code_point code;
+
+        // What the cell held when the key was typed, -1 when unknown.  A
+        // cell that already held the character doesn't confirm anything
+        // until the cursor moves past it.
+        long previous;
+
+        clock::time_point made;
+    };
+
+    enum class verdict { waiting, echoed, wrong };
+
+    static bool is_predictable(katerm::code_point code);
+
+    verdict judge(prediction const& p, katerm::position cursor, long code, clock::time_point now) const;
+    void start_epoch();
+    bool update_overlay();
+
+    bool enabled = false;
+    bool confirmed = false; // whether the program echoed a prediction of this epoch
+    std::vector<prediction> pending; // oldest first
+    std::vector<std::int32_t> shown;
+    std::vector<std::int32_t> next_shown;
+};
+
+template<class CellLookup>
+bool local_echo::typed(
+        katerm::code_point const code,
+        katerm::position const cursor,
+        int const width,
+        CellLookup const& cell,
+        clock::time_point const now)
+{
+    if (!enabled)
+        return false;
+
+    // A program that ignores what's typed shouldn't keep its predictions up
+    // until it produces output.
+    if (now >= deadline())
+        start_epoch();
+
+    auto const next = pending.empty()
+        ? cursor
+        : katerm::position{pending.back().column + 1, pending.back().row};
+
+    // Where the line wraps is up to the program.
+    if (!is_predictable(code) || next.x >= width) {
+        start_epoch();
+        return update_overlay();
+    }
+
+    pending.push_back({next.x, next.y, code, cell(next.x, next.y), now});
+    return update_overlay();
+}
+
+template<class CellLookup>
+bool local_echo::reconcile(
+        katerm::position const cursor,
+        CellLookup const& cell,
+        clock::time_point const now)
+{
+    std::size_t echoed = 0;
+
+    for (auto const& p : pending) {
+        auto const result = judge(p, cursor, cell(p.column, p.row), now);
+
+        if (result == verdict::wrong) {
+            start_epoch();
+            return update_overlay();
+        }
+
+        if (result == verdict::waiting)
+            break;
+
+        ++echoed;
+    }
+
+    if (echoed != 0) {
+        confirmed = true;
+        pending.erase(pending.begin(), pending.begin() + echoed);
+    }
+
+    return update_overlay();
+}
+
+} // gd100::
+
+#endif // header guard
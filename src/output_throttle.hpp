@@ -0,0 +1,90 @@
+#ifndef GDTERM_OUTPUT_THROTTLE_HPP
+#define GDTERM_OUTPUT_THROTTLE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+namespace gd100 {
+
+// Detects floods of output and limits how often the screen is serialized
+// while one is going on.
+//
+// All output is still decoded, only the intermediate screen states are never
+// sent, which gives the same effect as jump scrolling on a hardware terminal.
+class output_throttle {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // Throughput is measured over windows of this length.
+    static constexpr auto window_length = std::chrono::milliseconds{100};
+
+    // Output above this rate for flood_windows windows in a row is a flood.
+    static constexpr std::size_t flood_bytes_per_window = 64 * 1024;
+    static constexpr int flood_windows = 2;
+
+    // While flooded the screen is serialized at most once per frame.
+    static constexpr auto frame_interval = std::chrono::microseconds{16'666};
+
+    void record_bytes(std::size_t const count, clock::time_point const now)
+    {
+        if (now - window_start >= window_length) {
+            if (window_bytes >= flood_bytes_per_window)
+                busy_windows = std::min(busy_windows + 1, flood_windows);
+            else
+                busy_windows = 0;
+
+            // A window without any output in it ends the flood as well.
+            if (now - window_start >= 2 * window_length)
+                busy_windows = 0;
+
+            window_start = now;
+            window_bytes = 0;
+        }
+
+        window_bytes += count;
+    }
+
+    bool flooded() const noexcept
+    {
+        return busy_windows >= flood_windows;
+    }
+
+    // Returns whether a flush should happen now.  If not, the flush is
+    // postponed until deadline().
+    bool should_flush(clock::time_point const now)
+    {
+        if (flooded() && now - last_flush < frame_interval) {
+            pending = true;
+            return false;
+        }
+
+        return true;
+    }
+
+    void flushed(clock::time_point const now)
+    {
+        last_flush = now;
+        pending = false;
+    }
+
+    clock::time_point deadline() const
+    {
+        if (!pending)
+            return clock::time_point::max();
+
+        return last_flush + std::chrono::duration_cast<clock::duration>(frame_interval);
+    }
+
+private:
+    clock::time_point window_start{};
+    std::size_t window_bytes = 0;
+    int busy_windows = 0;
+
+    clock::time_point last_flush{};
+    bool pending = false;
+};
+
+} // gd100::
+
+#endif // header guard
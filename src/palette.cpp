@@ -0,0 +1,16 @@
+#include "palette.hpp"
+
+namespace gd100 {
+
+int ansi_palette_index(std::uint32_t const rgba) noexcept
+{
+    // All 16 are different, no need for anything smarter.
+    for (int i = 0; i != ansi_colour_count; ++i) {
+        if (default_palette[i] == rgba)
+            return i;
+    }
+
+    return -1;
+}
+
+} // gd100::
@@ -0,0 +1,57 @@
+#ifndef GDTERM_PALETTE_HPP
+#define GDTERM_PALETTE_HPP
+
+#include <array>
+#include <cstdint>
+
+namespace gd100 {
+
+// The 256 indexed colours as 0xRRGGBBAA, the same layout to_u32 uses for
+// katerm colours.
+using palette = std::array<std::uint32_t, 256>;
+
+// xterm's palette, which is what katerm resolves indexed colours with.
+constexpr palette make_default_palette()
+{
+    palette ret{
+        0x000000ff, 0xcd0000ff, 0x00cd00ff, 0xcdcd00ff,
+        0x0000eeff, 0xcd00cdff, 0x00cdcdff, 0xe5e5e5ff,
+        0x7f7f7fff, 0xff0000ff, 0x00ff00ff, 0xffff00ff,
+        0x5c5cffff, 0xff00ffff, 0x00ffffff, 0xffffffff,
+    };
+
+    constexpr std::uint32_t cube_levels[]{0, 95, 135, 175, 215, 255};
+
+    for (int i = 0; i != 216; ++i) {
+        auto const r = cube_levels[i / 36];
+        auto const g = cube_levels[i / 6 % 6];
+        auto const b = cube_levels[i % 6];
+        ret[16 + i] = r << 24 | g << 16 | b << 8 | 0xff;
+    }
+
+    for (int i = 0; i != 24; ++i) {
+        std::uint32_t const level = 8 + i * 10;
+        ret[232 + i] = level << 24 | level << 16 | level << 8 | 0xff;
+    }
+
+    return ret;
+}
+
+inline constexpr palette default_palette = make_default_palette();
+
+// The system colours, the first entries of the palette.
+constexpr int ansi_colour_count = 16;
+
+// Index of a colour among the 16 system colours of the default palette, or -1
+// if it isn't one of them.
+//
+// katerm only keeps the resolved colour of a cell, not whether it was set by
+// index or as true colour.  Only the system colours are taken to be indexed:
+// those are what themes change, and programs rarely set exactly one of them
+// as true colour.  The 256 colour cube and grey ramp are far more often hit
+// by accident by true colour output, so they stay plain colours.
+int ansi_palette_index(std::uint32_t rgba) noexcept;
+
+} // gd100::
+
+#endif // header guard
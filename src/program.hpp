@@ -1,13 +1,35 @@
 #ifndef GDTERM_PROGRAM_HPP
 #define GDTERM_PROGRAM_HPP
 
+#include <chrono>
 #include <cstdint>
 
 namespace gd100 {
 
+struct process_exit {
+    // Exit status of the process, or 128 + signal number when it was killed
+    // by a signal (same convention as the shell's $?).
+    int code;
+
+    std::chrono::microseconds user_time;
+    std::chrono::microseconds system_time;
+
+    // Maximum resident set size in kilobytes.
+    long max_rss;
+};
+
 class program {
 public:
+    using clock = std::chrono::steady_clock;
+
     virtual void handle_bytes(char const*, std::size_t, bool more_data_coming) = 0;
+    virtual void handle_exit(process_exit const&) {}
+
+    // A program that postponed a flush returns the moment it wants to be
+    // flushed at, the manager then calls handle_bytes(nullptr, 0, false) once
+    // that moment passes even if no new input arrived.
+    virtual clock::time_point flush_deadline() { return clock::time_point::max(); }
+
     virtual ~program() = default;
 };
 
@@ -2,50 +2,184 @@
 #include <iostream>
 #include <cstdio>
 #include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <string_view>
+#include <vector>
 
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include <poll.h>
 
 #include "program_terminal_manager.hpp"
+#include "trace.hpp"
 
 using namespace std::chrono_literals;
 
 namespace gd100 {
 
-constexpr std::size_t read_buffer_size = BUFSIZ;
+void adaptive_read_buffer::record_read(std::size_t const count)
+{
+    largest_read = std::max(largest_read, count);
+
+    // The output filled the whole buffer so there's likely a lot more queued
+    // up, next time hand it off in one bigger chunk.
+    if (growing && count == capacity && capacity < maximum_size)
+        reallocate(capacity * 2);
+}
 
-program_terminal_manager::program_terminal_manager()
-    : read_buffer{new char[read_buffer_size]}
+void adaptive_read_buffer::record_idle()
 {
-    int pipe_descriptors[2];
-    if (pipe2(pipe_descriptors, O_CLOEXEC))
-        throw std::runtime_error{"Couldn't create controller communication pipe."};
+    // Shrink back down once output stops coming in bulk.
+    if (largest_read < capacity / 4 && capacity > minimum_size)
+        reallocate(capacity / 2);
 
-    controller_read = pipe_descriptors[0];
-    controller_write = pipe_descriptors[1];
+    largest_read = 0;
+}
 
-    epoll_handle = epoll_create(EPOLL_CLOEXEC);
-    if (epoll_handle < 0)
-        throw std::runtime_error{"Couldn't create epoll handle."};
+void adaptive_read_buffer::reallocate(std::size_t const new_capacity)
+{
+    // The contents don't need to be preserved, data is handed off to the
+    // program before the next read.
+    buffer.reset(new char[new_capacity]);
+    capacity = new_capacity;
+}
 
-    epoll_data data;
-    data.fd = controller_read;
+namespace {
 
-    epoll_event controller_event_spec{
-        EPOLLIN,
-        data
-    };
+constexpr unsigned uring_entries = 256;
+
+// Registered buffers, programs beyond the slot count read into their
+// adaptive buffer with a plain read request instead.
+constexpr int fixed_slot_count = 64;
+constexpr std::size_t fixed_slot_size = 64 * 1024;
+
+// After input arrives we wait this long for more before flushing, like the
+// sleep in the epoll backend.
+constexpr auto uring_coalesce_duration = 2ms;
+
+// Most epoll events handled per wakeup.
+constexpr int max_events = 32;
+
+// Parse time per cycle.  The focused program gets about a frame, every other
+// program gets a slice of what's left for the background programs together.
+constexpr auto focused_parse_budget = 16666us;
+constexpr auto background_parse_budget = 4ms;
+constexpr auto background_cycle_budget = 8ms;
+
+template<class Operation>
+std::uint64_t to_user_data(Operation const op, std::uint64_t const value)
+{
+    return static_cast<std::uint64_t>(op) << 56 | value;
+}
+
+} // ::
+
+io_backend io_backend_from_environment()
+{
+    auto const name = std::getenv("GD100_IO_BACKEND");
+    if (name && std::string_view{name} == "io_uring")
+        return io_backend::io_uring;
+
+    return io_backend::epoll;
+}
+
+program_terminal_manager::program_terminal_manager(io_backend const requested, bool const growing)
+    : requested_backend{requested}
+    , growing_buffers{growing}
+{
+}
 
-    if (epoll_ctl(epoll_handle, EPOLL_CTL_ADD, controller_read, &controller_event_spec))
-        throw std::runtime_error{"Couldn't add controller read to epoll."};
+io_backend program_terminal_manager::backend() const noexcept
+{
+    if (!backend_ready)
+        return requested_backend;
 
-    controller = std::thread{[this] { controller_loop(); }};
+    return uring ? io_backend::io_uring : io_backend::epoll;
 }
 
-program* program_terminal_manager::get_program(int fid)
+// Requires lifecycle_mutex to be held.
+void program_terminal_manager::setup_backend()
+{
+    if (backend_ready)
+        return;
+
+    controller_event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (controller_event < 0)
+        throw std::runtime_error{"Couldn't create controller eventfd."};
+
+    if (requested_backend == io_backend::io_uring)
+        setup_uring();
+
+    if (!uring) {
+        epoll_handle = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_handle < 0)
+            throw std::runtime_error{"Couldn't create epoll handle."};
+
+        epoll_data data;
+        data.fd = controller_event;
+
+        epoll_event controller_event_spec{
+            EPOLLIN,
+            data
+        };
+
+        if (epoll_ctl(epoll_handle, EPOLL_CTL_ADD, controller_event, &controller_event_spec))
+            throw std::runtime_error{"Couldn't add controller eventfd to epoll."};
+    }
+
+    backend_ready = true;
+}
+
+// Requires lifecycle_mutex to be held.
+void program_terminal_manager::start_controller()
+{
+    {
+        auto lock = std::scoped_lock{mutex};
+        if (controller_running)
+            return;
+
+        controller_running = true;
+    }
+
+    // A previous controller found nothing to do and is exiting or has exited.
+    if (controller.joinable())
+        controller.join();
+
+    if (uring)
+        controller = std::thread{[this] { controller_loop_uring(); }};
+    else
+        controller = std::thread{[this] { controller_loop(); }};
+}
+
+void program_terminal_manager::wake_controller()
+{
+    std::uint64_t const one = 1;
+    write(controller_event, &one, sizeof(one));
+}
+
+bool program_terminal_manager::keep_running()
+{
+    if (stopping)
+        return false;
+
+    auto lock = std::scoped_lock{mutex};
+    if (!registered.empty() || !watched.empty() || !in_flight.empty())
+        return true;
+
+    // Anyone registering a program from now on starts a new controller.
+    controller_running = false;
+    return false;
+}
+
+std::shared_ptr<program_terminal_manager::registration> program_terminal_manager::get_registration(int fid)
 {
     auto lock = std::scoped_lock{mutex};
 
@@ -53,16 +187,46 @@ program* program_terminal_manager::get_program(int fid)
     if (it == registered.end())
         return nullptr;
 
-    return it->second.get();
+    return it->second;
 }
 
-program* program_terminal_manager::register_program(int fid, std::unique_ptr<program> prg)
+std::shared_ptr<program> program_terminal_manager::get_program(int fid)
+{
+    auto const reg = get_registration(fid);
+    if (!reg)
+        return nullptr;
+
+    return {reg, reg->prg.get()};
+}
+
+program* program_terminal_manager::register_program(int fid, pid_t pid, std::unique_ptr<program> prg)
 {
     auto ret = prg.get();
 
+    auto lifecycle_lock = std::scoped_lock{lifecycle_mutex};
+    setup_backend();
+
     {
         auto lock = std::scoped_lock{mutex};
-        registered[fid] = std::move(prg);
+        auto& reg = registered[fid];
+        reg = std::make_shared<registration>();
+        reg->prg = std::move(prg);
+        reg->buffer = adaptive_read_buffer{growing_buffers};
+
+        if (uring && !free_fixed_slots.empty()) {
+            reg->fixed_slot = free_fixed_slots.back();
+            free_fixed_slots.pop_back();
+        }
+    }
+
+    if (uring) {
+        if (pid > 0)
+            watch_process(fid, pid);
+
+        // The controller arms the read.
+        start_controller();
+        wake_controller();
+        return ret;
     }
 
     epoll_data data;
@@ -76,89 +240,730 @@ program* program_terminal_manager::register_program(int fid, std::unique_ptr<pro
     if (epoll_ctl(epoll_handle, EPOLL_CTL_ADD, fid, &program_event_spec))
         throw std::runtime_error{"Couldn't add program read to epoll."};
 
+    if (pid > 0)
+        watch_process(fid, pid);
+
+    start_controller();
     return ret;
 }
 
-void program_terminal_manager::unregister_program(int fid)
+void program_terminal_manager::remove_program(int const fid)
 {
+    std::shared_ptr<registration> reg;
+    bool cancel_read = false;
+
+    {
+        auto lock = std::scoped_lock{mutex};
+
+        auto const it = registered.find(fid);
+        if (it == registered.end())
+            return;
+
+        reg = std::move(it->second);
+        registered.erase(it);
+
+        for (auto& [pidfd, process] : watched) {
+            if (process.program_fid == fid)
+                process.program_fid = -1;
+        }
+
+        // The kernel may still be reading into the fixed slot, in that case
+        // it's released when the read completes.
+        cancel_read = in_flight.count(fid) != 0;
+        if (!cancel_read && reg->fixed_slot != -1)
+            free_fixed_slots.push_back(reg->fixed_slot);
+    }
+
+    if (uring) {
+        auto uring_lock = std::scoped_lock{uring_mutex};
+
+        // The write in flight finishes, what's queued behind it would go to
+        // whatever gets this descriptor number next.
+        if (auto const writes = pending_writes.find(fid); writes != pending_writes.end()) {
+            auto& queue = writes->second;
+            queue.erase(queue.begin() + 1, queue.end());
+            queue.front().abandoned = true;
+        }
+
+        if (cancel_read) {
+            auto const sqe = next_sqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = to_user_data(uring_operation::read, static_cast<std::uint32_t>(fid));
+            sqe->user_data = to_user_data(uring_operation::cancel, 0);
+
+            uring->submit();
+            ++stats.submit_calls;
+        }
+    } else {
+        epoll_data data;
+        data.fd = fid;
+        epoll_event program_event_spec{{}, data};
+
+        // Fails harmlessly when a hang up already took it out.
+        epoll_ctl(epoll_handle, EPOLL_CTL_DEL, fid, &program_event_spec);
+    }
+
+    // Let the controller notice when this was the last program.
+    wake_controller();
+}
+
+void program_terminal_manager::recheck_deadlines()
+{
+    wake_controller();
+}
+
+void program_terminal_manager::watch_process(int fid, pid_t pid)
+{
+    // Not every libc exposes pidfd_open yet, so go through syscall directly.
+    // Kernels older than 5.3 don't have it at all, in that case the program
+    // simply doesn't get exit notifications.
+    auto const pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    if (pidfd < 0)
+        return;
+
+    fcntl(pidfd, F_SETFD, FD_CLOEXEC);
+
+    {
+        auto lock = std::scoped_lock{mutex};
+        watched[pidfd] = watched_process{pid, fid};
+    }
+
+    // With io_uring the controller picks it up when it arms requests.
+    if (uring)
+        return;
+
+    epoll_data data;
+    data.fd = pidfd;
+
+    epoll_event process_event_spec{
+        EPOLLIN,
+        data
+    };
+
+    if (epoll_ctl(epoll_handle, EPOLL_CTL_ADD, pidfd, &process_event_spec))
+        throw std::runtime_error{"Couldn't add process pidfd to epoll."};
+}
+
+bool program_terminal_manager::handle_process_exit(int pidfd)
+{
+    watched_process process;
+
+    {
+        auto lock = std::scoped_lock{mutex};
+        auto it = watched.find(pidfd);
+        if (it == watched.end())
+            return false;
+
+        process = it->second;
+        watched.erase(it);
+    }
+
+    if (!uring) {
+        epoll_data data;
+        data.fd = pidfd;
+        epoll_event process_event_spec{{}, data};
+
+        if (epoll_ctl(epoll_handle, EPOLL_CTL_DEL, pidfd, &process_event_spec))
+            throw std::runtime_error{"Couldn't remove process pidfd from epoll."};
+    }
+
+    close(pidfd);
+
+    // A readable pidfd means the process has terminated, so this reaps the
+    // zombie without blocking.  If it fails someone else already reaped it
+    // and there's nothing left to report.
+    int status;
+    rusage usage;
+    if (wait4(process.pid, &status, WNOHANG, &usage) != process.pid)
+        return true;
+
+    auto const to_microseconds = [](timeval const tv) {
+        return std::chrono::seconds{tv.tv_sec} + std::chrono::microseconds{tv.tv_usec};
+    };
+
+    auto const exit_info = process_exit{
+        WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status),
+        to_microseconds(usage.ru_utime),
+        to_microseconds(usage.ru_stime),
+        usage.ru_maxrss,
+    };
+
+    if (auto const program = get_program(process.program_fid))
+        program->handle_exit(exit_info);
+
+    return true;
+}
+
+// Takes a hung up program out of epoll.  remove_program may have beaten the
+// controller to it, the descriptor can even be closed or reused by another
+// program already then.
+void program_terminal_manager::unregister_program(int fid, registration const* const expected)
+{
+    auto lock = std::scoped_lock{mutex};
+
+    auto const it = registered.find(fid);
+    if (it == registered.end() || (expected && it->second.get() != expected))
+        return;
+
     epoll_data data;
     data.fd = fid;
     epoll_event program_event_spec{{}, data};
 
-    if (epoll_ctl(epoll_handle, EPOLL_CTL_DEL, fid, &program_event_spec))
+    if (epoll_ctl(epoll_handle, EPOLL_CTL_DEL, fid, &program_event_spec) && errno != ENOENT)
         throw std::runtime_error{"Couldn't remove program read to epoll."};
 }
 
+void program_terminal_manager::read_program_input(
+    int const fid, registration& reg, std::chrono::nanoseconds const budget, bool const coalesce)
+{
+    auto const span = trace_span{"read-input"};
+    auto const program = reg.prg.get();
+    auto& buffer = reg.buffer;
+
+    // As long as there's input we keep reading until the budget is used up
+    auto const parse_start = std::chrono::steady_clock::now();
+
+    // We read some input and indicate to the processor whether more
+    // input is expected.  This way the processor can wait before
+    // displaying the data or doing some other expensive operation.
+    auto has_input = true;
+    auto read_failed = false;
+    for (int i = 0; has_input && !read_failed; ++i) {
+        // Keep reading while there's more, a pseudoterminal only gives out
+        // about 4 KB at a time and every chunk costs the program a lock and
+        // a flush check.
+        std::size_t filled = 0;
+        while (has_input && filled < buffer.size()) {
+            auto const read_count = read(fid, buffer.data() + filled, buffer.size() - filled);
+            ++stats.read_calls;
+            if (read_count <= 0) {
+                read_failed = true;
+                break;
+            }
+
+            stats.bytes_read += read_count;
+
+            if (i == 0 && filled == 0 && coalesce) {
+                // There's a large likelyhood we'll get more input,
+                // so we sleep for a little bit before doing the 'more input' check.
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+
+            filled += read_count;
+
+            pollfd poll_has_input;
+            poll_has_input.fd = fid;
+            poll_has_input.events = POLLIN;
+            auto const pollres = poll(&poll_has_input, 1, 0);
+            ++stats.poll_calls;
+            has_input = pollres == 1;
+        }
+
+        if (filled == 0)
+            break;
+
+        program->handle_bytes(buffer.data(), filled, has_input && !read_failed);
+        ++stats.handoffs;
+
+        // Only grow after the data has been handed off, growing discards the
+        // buffer contents.
+        buffer.record_read(filled);
+
+        auto const parse_now = std::chrono::steady_clock::now();
+        if ((parse_now - parse_start) > budget)
+            break;
+    }
+
+    // Even though more data is in the file descriptor we're not
+    // going to extract it immediately.  This call gives the
+    // processor an opportunity to flush.
+    if (has_input)
+        program->handle_bytes(nullptr, 0, false);
+    else
+        buffer.record_idle();
+}
+
+void program_terminal_manager::set_focused(int const fid, bool const focused)
+{
+    if (auto const reg = get_registration(fid))
+        reg->focused = focused;
+}
+
+void program_terminal_manager::write_input(int const fid, char const* const data, std::size_t const size)
+{
+    if (!uring) {
+        write(fid, data, size);
+        ++stats.write_calls;
+        return;
+    }
+
+    auto w = pending_write{fid, std::unique_ptr<char[]>{new char[size]}, size};
+    std::copy_n(data, size, w.data.get());
+
+    auto lock = std::scoped_lock{uring_mutex};
+
+    auto& queue = pending_writes[fid];
+    queue.push_back(std::move(w));
+
+    // Otherwise the completion of the write in flight queues this one.
+    if (queue.size() != 1)
+        return;
+
+    queue_uring_write(queue.front());
+
+    uring->submit();
+    ++stats.submit_calls;
+}
+
+void program_terminal_manager::setup_uring()
+{
+    auto queue = io_uring_queue::create(uring_entries);
+    if (!queue)
+        return;
+
+    uring.emplace(std::move(*queue));
+
+    fixed_buffers.reset(new char[fixed_slot_count * fixed_slot_size]);
+
+    std::vector<iovec> slots(fixed_slot_count);
+    for (int i = 0; i != fixed_slot_count; ++i)
+        slots[i] = iovec{fixed_buffers.get() + i * fixed_slot_size, fixed_slot_size};
+
+    // Registering pins the memory, which can fail on a low RLIMIT_MEMLOCK.
+    // Plain reads still work in that case.
+    if (!uring->register_buffers(slots.data(), slots.size())) {
+        fixed_buffers.reset();
+        return;
+    }
+
+    for (int i = fixed_slot_count; i-- != 0;)
+        free_fixed_slots.push_back(i);
+}
+
+// Requires uring_mutex to be held.  Submits what's prepared when the
+// submission queue is full.  The kernel takes every entry unless it's out of
+// memory or can't keep up with completions, waiting for room could then
+// deadlock the controller so that's treated as fatal.
+io_uring_sqe* program_terminal_manager::next_sqe()
+{
+    for (;;) {
+        if (auto const sqe = uring->get_sqe())
+            return sqe;
+
+        auto const submitted = uring->submit();
+        ++stats.submit_calls;
+
+        if (submitted < 0 && errno != EINTR)
+            throw std::runtime_error{"Couldn't submit to the io_uring."};
+    }
+}
+
+// Requires uring_mutex to be held.
+void program_terminal_manager::queue_uring_write(pending_write const& w)
+{
+    auto const sqe = next_sqe();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = w.fid;
+    sqe->addr = reinterpret_cast<std::uint64_t>(w.data.get() + w.written);
+    sqe->len = static_cast<std::uint32_t>(w.size - w.written);
+    sqe->off = static_cast<std::uint64_t>(-1);
+    sqe->user_data = to_user_data(uring_operation::write, static_cast<std::uint32_t>(w.fid));
+}
+
+void program_terminal_manager::arm_uring_requests()
+{
+    auto uring_lock = std::scoped_lock{uring_mutex};
+
+    if (!controller_armed) {
+        auto const sqe = next_sqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = controller_event;
+        sqe->poll32_events = POLLIN;
+        sqe->user_data = to_user_data(uring_operation::controller, 0);
+        controller_armed = true;
+    }
+
+    auto lock = std::scoped_lock{mutex};
+
+    for (auto& [fid, reg] : registered) {
+        if (reg->hung_up || in_flight.count(fid))
+            continue;
+
+        auto const sqe = next_sqe();
+        sqe->fd = fid;
+        sqe->off = static_cast<std::uint64_t>(-1);
+        sqe->user_data = to_user_data(uring_operation::read, static_cast<std::uint32_t>(fid));
+
+        if (reg->fixed_slot != -1) {
+            sqe->opcode = IORING_OP_READ_FIXED;
+            sqe->addr = reinterpret_cast<std::uint64_t>(fixed_buffers.get() + reg->fixed_slot * fixed_slot_size);
+            sqe->len = fixed_slot_size;
+            sqe->buf_index = static_cast<std::uint16_t>(reg->fixed_slot);
+        } else {
+            sqe->opcode = IORING_OP_READ;
+            sqe->addr = reinterpret_cast<std::uint64_t>(reg->buffer.data());
+            sqe->len = static_cast<std::uint32_t>(reg->buffer.size());
+        }
+
+        in_flight[fid] = reg;
+        ++stats.read_requests;
+    }
+
+    for (auto& [pidfd, process] : watched) {
+        if (process.armed)
+            continue;
+
+        auto const sqe = next_sqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = pidfd;
+        sqe->poll32_events = POLLIN;
+        sqe->user_data = to_user_data(uring_operation::process, static_cast<std::uint32_t>(pidfd));
+        process.armed = true;
+    }
+
+    if (uring->submit() > 0)
+        ++stats.submit_calls;
+}
+
+bool program_terminal_manager::handle_uring_read(int const fid, int const result, std::vector<int>& dirty)
+{
+    std::shared_ptr<registration> reg;
+
+    {
+        auto lock = std::scoped_lock{mutex};
+
+        auto const it = in_flight.find(fid);
+        if (it == in_flight.end())
+            return false;
+
+        reg = std::move(it->second);
+        in_flight.erase(it);
+
+        // Removed while the read was in flight, now the slot can be reused.
+        auto const current = registered.find(fid);
+        if (current == registered.end() || current->second != reg) {
+            if (reg->fixed_slot != -1)
+                free_fixed_slots.push_back(reg->fixed_slot);
+
+            return false;
+        }
+    }
+
+    // A late cancel for a removed program whose descriptor number got reused
+    // can hit this read, it's simply armed again.
+    if (result == -EINTR || result == -EAGAIN || result == -ECANCELED)
+        return false;
+
+    // A pseudoterminal master reports EIO once the slave side is closed,
+    // that's the equivalent of EPOLLHUP.
+    if (result <= 0) {
+        reg->hung_up = true;
+        return false;
+    }
+
+    stats.bytes_read += result;
+
+    auto const span = trace_span{"read-input"};
+
+    auto const data = reg->fixed_slot != -1
+                      ? fixed_buffers.get() + reg->fixed_slot * fixed_slot_size
+                      : reg->buffer.data();
+
+    // Whether more is coming isn't known yet, the program is flushed once
+    // the input stops for a moment.
+    reg->prg->handle_bytes(data, result, true);
+    ++stats.handoffs;
+
+    if (reg->fixed_slot == -1)
+        reg->buffer.record_read(result);
+
+    if (std::find(dirty.begin(), dirty.end(), fid) == dirty.end())
+        dirty.push_back(fid);
+
+    return true;
+}
+
+void program_terminal_manager::handle_uring_write(int const fid, int const result)
+{
+    auto lock = std::scoped_lock{uring_mutex};
+
+    auto const it = pending_writes.find(fid);
+    if (it == pending_writes.end())
+        return;
+
+    auto& queue = it->second;
+    auto& w = queue.front();
+    if (result > 0)
+        w.written += result;
+
+    auto const retry = result == -EINTR || result == -EAGAIN || (result > 0 && w.written != w.size);
+    if (retry && !w.abandoned) {
+        queue_uring_write(w);
+        return;
+    }
+
+    queue.pop_front();
+    if (queue.empty())
+        pending_writes.erase(it);
+    else
+        queue_uring_write(queue.front());
+}
+
+void program_terminal_manager::controller_loop_uring()
+{
+    // Programs that received input since their last flush.
+    std::vector<int> dirty;
+    auto flush_at = program::clock::time_point::max();
+    auto flush_deadline = program::clock::time_point::max();
+
+    // Read completions of one wakeup, handled focused programs first.
+    std::vector<std::pair<int, int>> reads;
+
+    auto const focused_first = [&](auto& fids, auto const& get_fid) {
+        std::stable_partition(fids.begin(), fids.end(), [&](auto const& entry) {
+            auto const reg = get_registration(get_fid(entry));
+            return reg && reg->focused;
+        });
+    };
+
+    auto const flush_dirty = [&] {
+        auto const span = trace_span{"flush"};
+        focused_first(dirty, [](int const fid) { return fid; });
+
+        for (auto const fid : dirty) {
+            if (auto const program = get_program(fid))
+                program->handle_bytes(nullptr, 0, false);
+        }
+
+        for (auto const fid : dirty) {
+            if (auto const reg = get_registration(fid); reg && reg->fixed_slot == -1)
+                reg->buffer.record_idle();
+        }
+
+        dirty.clear();
+        flush_at = program::clock::time_point::max();
+        flush_deadline = program::clock::time_point::max();
+    };
+
+    while (keep_running()) {
+        arm_uring_requests();
+
+        std::optional<std::chrono::nanoseconds> timeout;
+        if (auto const due = flush_due_programs(); due >= 0)
+            timeout = std::chrono::milliseconds{due};
+
+        if (!dirty.empty()) {
+            auto const until = std::chrono::nanoseconds{std::min(flush_at, flush_deadline) - program::clock::now()};
+            timeout = std::clamp(until, std::chrono::nanoseconds{0}, timeout.value_or(until));
+        }
+
+        auto const result = uring->wait(1, timeout);
+        ++stats.wakeups;
+
+        if (result < 0 && errno != ETIME && errno != EINTR)
+            throw std::runtime_error{"io_uring_enter failed."};
+
+        auto const was_dirty = !dirty.empty();
+
+        uring->for_each_completion([&](io_uring_cqe const& cqe) {
+            auto const operation = static_cast<uring_operation>(cqe.user_data >> 56);
+            auto const value = cqe.user_data & ((std::uint64_t{1} << 56) - 1);
+
+            switch (operation) {
+                case uring_operation::controller: {
+                    std::uint64_t wakeups;
+                    read(controller_event, &wakeups, sizeof(wakeups));
+                    controller_armed = false;
+                    break;
+                }
+
+                case uring_operation::cancel:
+                    break;
+
+                case uring_operation::read:
+                    reads.emplace_back(static_cast<int>(value), cqe.res);
+                    break;
+
+                case uring_operation::process:
+                    handle_process_exit(static_cast<int>(value));
+                    break;
+
+                case uring_operation::write:
+                    handle_uring_write(static_cast<int>(value), cqe.res);
+                    break;
+            }
+        });
+
+        focused_first(reads, [](auto const& read) { return read.first; });
+
+        auto got_input = false;
+        for (auto const& [fid, res] : reads)
+            got_input |= handle_uring_read(fid, res, dirty);
+
+        reads.clear();
+
+        auto const now = program::clock::now();
+
+        // Same timing as the epoll backend: wait a little for more input
+        // after the first chunk, but never delay a flush by more than a frame.
+        // Only input pushes the flush back, the timeout wake-up for the
+        // flush itself must not.
+        if (got_input) {
+            flush_at = now + uring_coalesce_duration;
+            if (!was_dirty)
+                flush_deadline = now + 16666us;
+        }
+
+        if (!dirty.empty() && (now >= flush_at || now >= flush_deadline))
+            flush_dirty();
+    }
+}
+
+int program_terminal_manager::flush_due_programs()
+{
+    auto const now = program::clock::now();
+    auto next_deadline = program::clock::time_point::max();
+
+    std::vector<std::shared_ptr<registration>> due;
+
+    {
+        auto lock = std::scoped_lock{mutex};
+        for (auto& [fid, reg] : registered) {
+            auto const deadline = reg->prg->flush_deadline();
+            if (deadline <= now)
+                due.push_back(reg);
+            else
+                next_deadline = std::min(next_deadline, deadline);
+        }
+    }
+
+    std::stable_partition(due.begin(), due.end(), [](auto const& reg) { return reg->focused.load(); });
+
+    for (auto const& reg : due) {
+        auto const span = trace_span{"deadline-flush"};
+        reg->prg->handle_bytes(nullptr, 0, false);
+    }
+
+    // Nothing to flush, sleep until there's input.
+    if (next_deadline == program::clock::time_point::max())
+        return -1;
+
+    // Round up, waking up before the deadline would just mean another trip
+    // through epoll_wait.
+    auto const timeout = std::chrono::ceil<std::chrono::milliseconds>(next_deadline - now);
+    return static_cast<int>(timeout.count());
+}
+
 void program_terminal_manager::controller_loop()
 {
-    while(!stopping) {
-        epoll_event event;
-        auto const poll_result = epoll_wait(epoll_handle, &event, 1, 1000);
+    epoll_event events[max_events];
+
+    struct ready_program {
+        int fid;
+        std::shared_ptr<registration> reg;
+        bool hung_up;
+        bool focused;
+    };
+
+    std::vector<ready_program> ready;
+    std::uint64_t cycle = 0;
+
+    while (keep_running()) {
+        auto const timeout = flush_due_programs();
+
+        auto const poll_result = epoll_wait(epoll_handle, events, max_events, timeout);
+        ++stats.wakeups;
 
         if (poll_result == -1)
             throw std::runtime_error{"epoll_wait failed."};
 
-        if (poll_result == 1) {
-            if (event.data.fd == controller_read)
-                continue;
+        ready.clear();
 
-            if (event.events & EPOLLIN) {
-                auto program = get_program(event.data.fd);
-                if (!program)
-                    continue;
-
-                // As long as there's input we keep reading for ~1 frame
-                constexpr auto parse_max_duration = 16.66ms;
-                auto const parse_start = std::chrono::steady_clock::now();
-
-                // We read some input and indicate to the processor whether more
-                // input is expected.  This way the processor can wait before
-                // displaying the data or doing some other expensive operation.
-                auto has_input = true;
-                for (int i = 0; has_input; ++i) {
-                    auto const read_count = read(event.data.fd, read_buffer.get(), read_buffer_size);
-                    if (read_count == -1)
-                        break;
-
-                    if (i == 0) {
-                        // There's a large likelyhood we'll get more input,
-                        // so we sleep for a little bit before doing the 'more input' check.
-                        std::this_thread::sleep_for(std::chrono::milliseconds(2));
-                    }
-
-                    pollfd poll_has_input;
-                    poll_has_input.fd = event.data.fd;
-                    poll_has_input.events = POLLIN;
-                    auto const pollres = poll(&poll_has_input, 1, 0);
-                    has_input = pollres == 1;
-
-                    program->handle_bytes(read_buffer.get(), read_count, has_input);
-
-                    auto const parse_now = std::chrono::steady_clock::now();
-                    if ((parse_now - parse_start) > parse_max_duration)
-                        break;
-                }
+        for (int i = 0; i != poll_result; ++i) {
+            auto const& event = events[i];
 
-                // Even though more data is in the file descriptor we're not
-                // going to extract it immediately.  This call gives the
-                // processor an opportunity to flush.
-                if (has_input)
-                    program->handle_bytes(nullptr, 0, false);
+            if (event.data.fd == controller_event) {
+                std::uint64_t wakeups;
+                read(controller_event, &wakeups, sizeof(wakeups));
+                continue;
             }
 
-            if (event.events & EPOLLHUP) {
+            if (handle_process_exit(event.data.fd))
+                continue;
+
+            auto const hung_up = (event.events & EPOLLHUP) != 0;
+
+            if (event.events & EPOLLIN) {
+                if (auto reg = get_registration(event.data.fd)) {
+                    auto const focused = reg->focused.load();
+                    ready.push_back({event.data.fd, std::move(reg), hung_up, focused});
+                }
+            } else if (hung_up) {
                 unregister_program(event.data.fd);
             }
         }
 
+        // epoll reports the programs that are still readable in the same
+        // order every time, so the ones that waited longest go first or the
+        // budget would always run out on the same programs.
+        std::stable_sort(ready.begin(), ready.end(), [](ready_program const& a, ready_program const& b) {
+            if (a.focused != b.focused)
+                return a.focused;
+
+            return a.reg->last_read < b.reg->last_read;
+        });
+
+        ++cycle;
+
+        std::optional<std::chrono::steady_clock::time_point> background_start;
+        auto coalesce = true;
+
+        for (auto const& p : ready) {
+            auto budget = std::chrono::nanoseconds{focused_parse_budget};
+
+            if (!p.focused) {
+                auto const now = std::chrono::steady_clock::now();
+                if (!background_start)
+                    background_start = now;
+
+                // Out of time, epoll is level triggered so the remaining
+                // programs are reported again by the next epoll_wait.
+                auto const left = background_cycle_budget - (now - *background_start);
+                if (left <= 0ns)
+                    break;
+
+                budget = std::min<std::chrono::nanoseconds>(background_parse_budget, left);
+            }
+
+            read_program_input(p.fid, *p.reg, budget, coalesce);
+            p.reg->last_read = cycle;
+            coalesce = false;
+
+            // The remaining input is read before the program goes away.
+            if (p.hung_up)
+                unregister_program(p.fid, p.reg.get());
+        }
     }
 }
 
 program_terminal_manager::~program_terminal_manager()
 {
     stopping = true;
-    write(controller_write, "w", 1); // wake up the controller thread
-    controller.join();
+
+    if (controller.joinable()) {
+        wake_controller();
+        controller.join();
+    }
+
+    if (epoll_handle >= 0)
+        close(epoll_handle);
+
+    if (controller_event >= 0)
+        close(controller_event);
+
+    for (auto const& [pidfd, process] : watched)
+        close(pidfd);
 }
 
 } // gd100::
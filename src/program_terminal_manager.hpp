@@ -6,37 +6,247 @@
 #include <unordered_map>
 #include <atomic>
 #include <memory>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
 
+#include <sys/types.h>
+
+#include "io_uring_queue.hpp"
 #include "program.hpp"
 
 namespace gd100 {
 
+// Counters for the I/O done by the controller thread, so the cost per byte of
+// output can be measured.
+struct io_statistics {
+    std::atomic<std::uint64_t> wakeups = 0;
+    std::atomic<std::uint64_t> read_calls = 0;
+    std::atomic<std::uint64_t> poll_calls = 0;
+    std::atomic<std::uint64_t> write_calls = 0;
+    std::atomic<std::uint64_t> submit_calls = 0;
+    std::atomic<std::uint64_t> bytes_read = 0;
+
+    // Chunks of output handed to programs.
+    std::atomic<std::uint64_t> handoffs = 0;
+
+    // io_uring read requests, these don't cost a system call each.
+    std::atomic<std::uint64_t> read_requests = 0;
+
+    std::uint64_t system_calls() const noexcept
+    {
+        return wakeups + read_calls + poll_calls + write_calls + submit_calls;
+    }
+};
+
+enum class io_backend {
+    epoll,
+
+    // Reads into registered buffers and writes without blocking the caller,
+    // with all requests of a controller cycle submitted at once.
+    io_uring,
+};
+
+// Backend named by the GD100_IO_BACKEND environment variable ("epoll" or
+// "io_uring"), epoll when it's not set.
+io_backend io_backend_from_environment();
+
+// Read buffer owned by a single program.  It starts out small and grows while
+// the output waiting for a program keeps filling it completely, so bulk output
+// is handed off in big chunks while interactive use doesn't hold on to a lot
+// of memory.
+//
+// A pseudoterminal master never returns more than about 4 KB per read, so the
+// buffer is filled with several reads before the program gets it.
+class adaptive_read_buffer {
+public:
+    static constexpr std::size_t minimum_size = 8 * 1024;
+    static constexpr std::size_t maximum_size = 256 * 1024;
+
+    // With growing off the buffer stays at minimum_size, for comparison in
+    // benchmarks.
+    explicit adaptive_read_buffer(bool const grow = true)
+        : growing{grow}
+    {
+    }
+
+    char* data() noexcept { return buffer.get(); }
+    std::size_t size() const noexcept { return capacity; }
+
+    // Called with the number of bytes handed to the program in one go.
+    void record_read(std::size_t count);
+
+    // Called when the program's input has been drained.
+    void record_idle();
+
+private:
+    void reallocate(std::size_t new_capacity);
+
+    std::unique_ptr<char[]> buffer{new char[minimum_size]};
+    std::size_t capacity = minimum_size;
+    std::size_t largest_read = 0;
+    bool growing;
+};
+
+// Nothing is set up until the first program is registered: the controller
+// thread, its epoll set or io_uring instance are created then.  The thread
+// exits again once no programs or processes are left, and while it runs it
+// only wakes up for input, exits, flush deadlines or being told to stop.
 class program_terminal_manager {
 public:
-    program_terminal_manager();
+    // Falls back to epoll when io_uring is requested but not available.
+    // growing_buffers is only turned off to measure what the adaptive read
+    // buffers gain.
+    explicit program_terminal_manager(io_backend requested = io_backend::epoll,
+                                      bool growing_buffers = true);
     program_terminal_manager(program_terminal_manager&&)=delete;
 
-    program* register_program(int fid, std::unique_ptr<program> prg);
+    // Until the first program is registered this is the requested backend,
+    // whether io_uring is actually available isn't known before that.
+    io_backend backend() const noexcept;
+
+    // When pid is positive the process is watched through a pidfd and the
+    // program is told about its exit via program::handle_exit.
+    program* register_program(int fid, pid_t pid, std::unique_ptr<program> prg);
+
+    // Stops reading from fid and destroys its program, possibly later on the
+    // controller thread if it's in use there.  The process stays watched so
+    // it's still reaped, but its exit is no longer reported.
+    void remove_program(int fid);
+
+    // Sends input to a program.  Safe to call from any thread.  With io_uring
+    // the data is copied and the call doesn't wait for the write.
+    void write_input(int fid, char const* data, std::size_t size);
+
+    // Focused programs are read and flushed before the others every cycle
+    // and may use up to a frame for parsing, the rest share a smaller budget
+    // and continue in the next cycle when it runs out.  Safe to call from
+    // any thread.
+    void set_focused(int fid, bool focused);
+
+    // Makes the controller ask every program for its flush_deadline again,
+    // for when a deadline moved closer on another thread.  Safe to call from
+    // any thread.
+    void recheck_deadlines();
+
+    io_statistics const& statistics() const noexcept { return stats; }
 
     ~program_terminal_manager();
 
 private:
-    program* get_program(int fid);
+    // Shared so the controller can keep using a program while it's removed.
+    struct registration {
+        std::unique_ptr<program> prg;
+        adaptive_read_buffer buffer;
+        std::atomic<bool> focused = false;
+
+        // epoll only, the controller cycle in which it was last read.
+        std::uint64_t last_read = 0;
+
+        // io_uring only
+        int fixed_slot = -1;
+        bool hung_up = false;
+    };
+
+    struct pending_write {
+        int fid;
+        std::unique_ptr<char[]> data;
+        std::size_t size;
+        std::size_t written = 0;
+        bool abandoned = false; // The program was removed, don't write the rest
+    };
+
+    // What an io_uring completion belongs to, stored in the top byte of the
+    // user data.
+    enum class uring_operation : std::uint8_t {
+        controller,
+        read,
+        process,
+        write,
+        cancel,
+    };
+
+    std::shared_ptr<registration> get_registration(int fid);
+    std::shared_ptr<program> get_program(int fid);
+
+    // Reads until the input stops or the budget is used up.  With coalesce
+    // set it first waits a little for more input to arrive.
+    void read_program_input(int fid, registration& reg, std::chrono::nanoseconds budget, bool coalesce);
+
+    void setup_backend();
+    void start_controller();
+    void wake_controller();
+
+    // Called by the controller before it waits, clears controller_running and
+    // returns false when there's nothing left to wait for.
+    bool keep_running();
+
+    // Flushes programs whose flush deadline passed and returns the epoll
+    // timeout until the next deadline, -1 when there is none.
+    int flush_due_programs();
     void controller_loop();
-    void unregister_program(int fid);
+    void unregister_program(int fid, registration const* expected = nullptr);
+
+    void setup_uring();
+    void controller_loop_uring();
+    void arm_uring_requests();
+    io_uring_sqe* next_sqe();
+    void queue_uring_write(pending_write const& w);
+    // Returns whether input was handed to the program.
+    bool handle_uring_read(int fid, int result, std::vector<int>& dirty);
+    void handle_uring_write(int fid, int result);
+
+    void watch_process(int fid, pid_t pid);
+    bool handle_process_exit(int pidfd);
 
 private:
+    struct watched_process {
+        pid_t pid;
+        int program_fid;
+        bool armed = false; // io_uring only
+    };
+
+    io_backend requested_backend;
+    bool growing_buffers;
+    std::atomic<bool> backend_ready = false;
+
+    // Serialises setting up the backend and starting the controller.
+    std::mutex lifecycle_mutex;
+
     std::thread controller;
     std::mutex mutex;
+    bool controller_running = false; // guarded by mutex
+
+    // eventfd the controller waits on besides its programs, written to stop
+    // it or make it look at the registered programs again.
+    int controller_event = -1;
+
+    int epoll_handle = -1;
+
+    // Set when using the io_uring backend.  uring_mutex serialises
+    // preparing and submitting requests, completions are only consumed by the
+    // controller thread.
+    std::optional<io_uring_queue> uring;
+    std::mutex uring_mutex;
+    std::unique_ptr<char[]> fixed_buffers;
+    std::vector<int> free_fixed_slots;
 
-    int controller_write;
-    int controller_read;
+    // Writes per program in the order they were made.  Only the front one is
+    // handed to the kernel, its completion queues the next, so two writes
+    // to the same terminal can't be reordered or interleaved.  Guarded by
+    // uring_mutex.
+    std::unordered_map<int, std::deque<pending_write>> pending_writes;
+    bool controller_armed = false; // only touched by the controller thread
 
-    int epoll_handle;
+    // Registrations with a read in flight, guarded by mutex.  Keeps a removed
+    // program's buffer alive until the kernel is done with it.
+    std::unordered_map<int, std::shared_ptr<registration>> in_flight;
 
-    std::unordered_map<int, std::unique_ptr<program>> registered;
+    std::unordered_map<int, std::shared_ptr<registration>> registered;
+    std::unordered_map<int, watched_process> watched; // keyed by pidfd
     std::atomic<bool> stopping = false;
-    std::unique_ptr<char[]> read_buffer;
+    io_statistics stats;
 };
 
 } // gd100::
@@ -0,0 +1,75 @@
+#include <stdexcept>
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+
+#include "pty_process.hpp"
+
+namespace gd100 {
+
+pty_process spawn_shell(katerm::extend const size)
+{
+    auto const masterfd = posix_openpt(O_RDWR | O_NOCTTY);
+    grantpt(masterfd);
+    unlockpt(masterfd);
+    auto const slavename = ptsname(masterfd);
+    auto const slavefd = open(slavename, O_RDWR | O_NOCTTY);
+    if (slavefd < 0) {
+        throw std::runtime_error{"Opening pseudoterminal slave failed."};
+    }
+    auto const fork_result = fork();
+
+    // child
+    if (fork_result == 0) {
+        close(masterfd);
+
+        setsid();
+        ioctl(slavefd, TIOCSCTTY, 0);
+
+        close(0);
+        close(1);
+        close(2);
+        dup2(slavefd, 0);
+        dup2(slavefd, 1);
+        dup2(slavefd, 2);
+
+        setenv("TERM", "gdterm", 1);
+
+        char command[] = "sh";
+
+        char* const args[]{
+            command,
+            nullptr,
+        };
+
+        execvp(command, args);
+
+        // Only returns when the shell couldn't be started.  Returning would
+        // run a copy of the parent in the child.
+        _exit(127);
+    }
+
+    if (fork_result == -1) {
+        abort();
+    }
+
+    // parent
+
+    close(slavefd);
+
+    auto const winsz = winsize{
+        static_cast<unsigned short>(size.height),
+        static_cast<unsigned short>(size.width),
+        0, 0
+    };
+
+    if(ioctl(masterfd, TIOCSWINSZ, &winsz))
+        throw std::runtime_error{"Couldn't set window size."};
+
+    return pty_process{masterfd, fork_result};
+}
+
+} // gd100::
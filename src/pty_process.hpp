@@ -0,0 +1,20 @@
+#ifndef GDTERM_PTY_PROCESS_HPP
+#define GDTERM_PTY_PROCESS_HPP
+
+#include <sys/types.h>
+
+#include <katerm/terminal.hpp>
+
+namespace gd100 {
+
+struct pty_process {
+    int master_descriptor;
+    pid_t pid;
+};
+
+// Starts a shell on a new pseudoterminal of the given size.
+pty_process spawn_shell(katerm::extend size);
+
+} // gd100::
+
+#endif // header guard
@@ -0,0 +1,492 @@
+// Headless stress test and benchmark for program_terminal_manager.
+//
+// Registers N terminals that decode and encode like the ones in the Godot
+// module, feeds them from producer threads over pseudoterminals or pipes and
+// reports flush latency, throughput and CPU time per MB for every N.
+//
+//   gd100-stress [--terminals 1,8,32,64] [--seconds 5] [--backend epoll|io_uring]
+//                [--producer mixed|steady|bursty|idle] [--transport pty|pipe]
+//                [--read-buffer adaptive|fixed]
+//
+// --read-buffer fixed keeps every program's read buffer at its minimum size,
+// comparing the reads and hand-offs per MB of the two shows what the
+// adaptive buffers save.
+//
+// The decode ms/MB column is the time spent in decode calls.
+//
+// Build with -DGD100_SANITIZE_THREAD=ON to run it under ThreadSanitizer.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <katerm/terminal.hpp>
+
+#include "tracking_decoder.hpp"
+#include "frame_encoder.hpp"
+#include "output_throttle.hpp"
+#include "program.hpp"
+#include "program_terminal_manager.hpp"
+#include "text_extraction.hpp"
+
+namespace {
+
+using steady_clock = std::chrono::steady_clock;
+using namespace std::chrono_literals;
+
+constexpr auto terminal_size = katerm::extend{132, 35};
+
+enum class producer_kind {
+    steady, // writes as fast as the terminal reads
+    bursty, // a screenful or more at once, then a pause
+    idle,   // a short line now and then, like someone typing
+};
+
+enum class transport {
+    pty,
+    pipe,
+};
+
+struct options {
+    std::vector<int> terminal_counts{1, 8, 32, 64};
+    std::chrono::seconds duration{5};
+    gd100::io_backend backend = gd100::io_backend::epoll;
+    std::optional<producer_kind> producer; // mixed when not set
+    transport channel = transport::pty;
+    bool growing_buffers = true;
+};
+
+std::int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+// Decodes and encodes like terminal_program in the Godot module, minus the
+// Godot side.  Latency is measured from the first write that wasn't flushed
+// yet to the flush that shows it.
+class stress_program : public gd100::program {
+public:
+    explicit stress_program(int const md)
+        : terminal{terminal_size}
+        , master_descriptor{md}
+    {
+    }
+
+    ~stress_program()
+    {
+        close(master_descriptor);
+    }
+
+    void handle_bytes(char const* const bytes, std::size_t const count, bool const more_data_coming) override
+    {
+        auto lock = std::scoped_lock{terminal_mutex};
+
+        auto const now = clock::now();
+        throttle.record_bytes(count, now);
+        bytes_decoded += count;
+
+        katerm::terminal_instructee t{&terminal};
+        auto const decode_start = now_ns();
+        decoder.decode(bytes, count, t);
+        decode_ns += now_ns() - decode_start;
+
+        if (more_data_coming || !throttle.should_flush(now))
+            return;
+
+        throttle.flushed(now);
+
+        encoder.encode(terminal, decoder.cursor());
+        terminal.screen.clear_changes();
+
+        if (auto const since = unflushed_since.exchange(0); since != 0)
+            latencies.push_back(now_ns() - since);
+    }
+
+    clock::time_point flush_deadline() override
+    {
+        auto lock = std::scoped_lock{terminal_mutex};
+        return throttle.deadline();
+    }
+
+    // What the Godot thread does with a terminal now and then.
+    void inspect()
+    {
+        auto lock = std::scoped_lock{terminal_mutex};
+        gd100::extract_line_text(terminal, 0);
+    }
+
+    std::mutex terminal_mutex;
+    katerm::terminal terminal;
+    gd100::tracking_decoder decoder;
+    gd100::frame_encoder encoder;
+    gd100::output_throttle throttle;
+
+    int master_descriptor;
+    std::atomic<std::uint64_t> bytes_decoded = 0;
+    std::int64_t decode_ns = 0; // guarded by terminal_mutex
+    std::atomic<std::int64_t> unflushed_since = 0;
+    std::vector<std::int64_t> latencies; // guarded by terminal_mutex
+};
+
+// Output with some colour and line structure so the decoder sees more than
+// printable text.
+std::string make_payload(std::size_t const size)
+{
+    std::string ret;
+    std::minstd_rand rng{42};
+
+    while (ret.size() < size) {
+        ret += "\x1b[3" + std::to_string(rng() % 8) + "m";
+        for (int i = 0; i != 60; ++i)
+            ret += static_cast<char>('a' + rng() % 26);
+
+        ret += "\x1b[0m ok\r\n";
+    }
+
+    ret.resize(size);
+    return ret;
+}
+
+struct channel_ends {
+    int master; // read by the manager
+    int slave;  // written by the producer
+};
+
+channel_ends open_channel(transport const channel)
+{
+    if (channel == transport::pipe) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC))
+            throw std::runtime_error{"pipe2 failed."};
+
+        return {fds[0], fds[1]};
+    }
+
+    auto const master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0 || grantpt(master) || unlockpt(master))
+        throw std::runtime_error{"Couldn't open a pseudoterminal."};
+
+    auto const slave = open(ptsname(master), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (slave < 0)
+        throw std::runtime_error{"Opening pseudoterminal slave failed."};
+
+    // No newline translation or echo, the bytes should arrive as written.
+    termios attributes;
+    tcgetattr(slave, &attributes);
+    cfmakeraw(&attributes);
+    tcsetattr(slave, TCSANOW, &attributes);
+
+    return {master, slave};
+}
+
+std::chrono::microseconds thread_cpu_time()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+
+    return std::chrono::seconds{usage.ru_utime.tv_sec + usage.ru_stime.tv_sec}
+         + std::chrono::microseconds{usage.ru_utime.tv_usec + usage.ru_stime.tv_usec};
+}
+
+std::chrono::microseconds process_cpu_time()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return std::chrono::seconds{usage.ru_utime.tv_sec + usage.ru_stime.tv_sec}
+         + std::chrono::microseconds{usage.ru_utime.tv_usec + usage.ru_stime.tv_usec};
+}
+
+void produce(producer_kind const kind, int const fd, stress_program& prg,
+             std::string const& payload, std::atomic<bool> const& stop,
+             std::atomic<std::int64_t>& cpu_us, unsigned const seed)
+{
+    std::minstd_rand rng{seed};
+
+    auto const write_all = [&](char const* data, std::size_t size) {
+        std::int64_t zero = 0;
+        prg.unflushed_since.compare_exchange_strong(zero, now_ns());
+
+        while (size != 0 && !stop) {
+            auto const written = write(fd, data, size);
+            if (written <= 0)
+                return;
+
+            data += written;
+            size -= written;
+        }
+    };
+
+    while (!stop) {
+        switch (kind) {
+            case producer_kind::steady:
+                write_all(payload.data(), 4096);
+                break;
+
+            case producer_kind::bursty: {
+                auto const size = 16 * 1024 + rng() % (48 * 1024);
+                write_all(payload.data(), std::min<std::size_t>(size, payload.size()));
+                std::this_thread::sleep_for(std::chrono::milliseconds{50 + rng() % 150});
+                break;
+            }
+
+            case producer_kind::idle:
+                write_all(payload.data(), 1 + rng() % 40);
+                std::this_thread::sleep_for(std::chrono::milliseconds{100 + rng() % 400});
+                break;
+        }
+    }
+
+    cpu_us += thread_cpu_time().count();
+}
+
+char const* producer_name(producer_kind const kind)
+{
+    switch (kind) {
+        case producer_kind::steady: return "steady";
+        case producer_kind::bursty: return "bursty";
+        case producer_kind::idle: return "idle";
+    }
+
+    return "?";
+}
+
+double percentile(std::vector<std::int64_t>& samples, double const p)
+{
+    if (samples.empty())
+        return 0;
+
+    auto const index = static_cast<std::size_t>(p * (samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index] / 1e6;
+}
+
+void run(options const& opts, int const terminal_count)
+{
+    gd100::program_terminal_manager manager{opts.backend, opts.growing_buffers};
+    auto const payload = make_payload(64 * 1024);
+
+    std::vector<stress_program*> programs;
+    std::vector<int> slaves;
+    std::vector<producer_kind> kinds;
+
+    for (int i = 0; i != terminal_count; ++i) {
+        auto const ends = open_channel(opts.channel);
+        auto const prg = static_cast<stress_program*>(manager.register_program(
+            ends.master, 0, std::make_unique<stress_program>(ends.master)));
+
+        programs.push_back(prg);
+        slaves.push_back(ends.slave);
+        kinds.push_back(opts.producer.value_or(static_cast<producer_kind>(i % 3)));
+    }
+
+    std::atomic<bool> stop = false;
+    std::atomic<std::int64_t> producer_cpu_us = 0;
+    std::vector<std::thread> producers;
+
+    auto const cpu_before = process_cpu_time();
+    auto const start = steady_clock::now();
+
+    for (int i = 0; i != terminal_count; ++i) {
+        producers.emplace_back(produce, kinds[i], slaves[i], std::ref(*programs[i]),
+                               std::cref(payload), std::cref(stop),
+                               std::ref(producer_cpu_us), static_cast<unsigned>(i));
+    }
+
+    // Stands in for the Godot main thread: switches focus around and reads
+    // text while the controller decodes.
+    std::thread inspector{[&] {
+        auto focused = 0;
+        for (auto tick = 0; !stop; ++tick) {
+            if (tick % 60 == 0) {
+                manager.set_focused(programs[focused]->master_descriptor, false);
+                focused = (focused + 1) % terminal_count;
+                manager.set_focused(programs[focused]->master_descriptor, true);
+            }
+
+            programs[tick % terminal_count]->inspect();
+            std::this_thread::sleep_for(16ms);
+        }
+    }};
+
+    std::this_thread::sleep_for(opts.duration);
+
+    auto const elapsed = std::chrono::duration<double>{steady_clock::now() - start};
+    std::uint64_t total_bytes = 0;
+    for (auto const prg : programs)
+        total_bytes += prg->bytes_decoded;
+
+    stop = true;
+
+    // The controller keeps reading, so producers blocked in a write get out.
+    for (auto& producer : producers)
+        producer.join();
+
+    inspector.join();
+
+    for (auto const slave : slaves)
+        close(slave);
+
+    auto const cpu_after = process_cpu_time();
+
+    std::vector<std::int64_t> all_latencies;
+    double worst_p99 = 0;
+    std::int64_t decode_ns = 0;
+    std::uint64_t final_bytes = 0;
+
+    for (auto const prg : programs) {
+        auto lock = std::scoped_lock{prg->terminal_mutex};
+        all_latencies.insert(all_latencies.end(), prg->latencies.begin(), prg->latencies.end());
+        worst_p99 = std::max(worst_p99, percentile(prg->latencies, 0.99));
+        decode_ns += prg->decode_ns;
+        final_bytes += prg->bytes_decoded;
+    }
+
+    for (auto const prg : programs)
+        manager.remove_program(prg->master_descriptor);
+
+    auto const megabytes = total_bytes / (1024.0 * 1024.0);
+    auto const consumer_cpu = cpu_after - cpu_before - std::chrono::microseconds{producer_cpu_us};
+    auto const cpu_ms = std::chrono::duration<double, std::milli>{consumer_cpu}.count();
+
+    auto const& stats = manager.statistics();
+    auto const per_megabyte = [&](std::uint64_t const count) {
+        return megabytes > 0 ? count / megabytes : 0.0;
+    };
+
+    // Producers are joined after the throughput was taken, decode time is
+    // divided by everything that was decoded up to now.
+    auto const final_megabytes = final_bytes / (1024.0 * 1024.0);
+    auto const decode_ms = decode_ns / 1e6;
+
+    std::printf("%5d %8.1f %9.2f %12.2f %8.1f %8.1f %9.1f %8.2f %8.2f %8.2f %8.2f %9.2f %10llu\n",
+                terminal_count,
+                megabytes / elapsed.count(),
+                megabytes > 0 ? cpu_ms / megabytes : 0.0,
+                final_megabytes > 0 ? decode_ms / final_megabytes : 0.0,
+                per_megabyte(stats.read_calls + stats.read_requests),
+                per_megabyte(stats.poll_calls),
+                per_megabyte(stats.handoffs),
+                percentile(all_latencies, 0.5),
+                percentile(all_latencies, 0.9),
+                percentile(all_latencies, 0.99),
+                all_latencies.empty() ? 0.0 : *std::max_element(all_latencies.begin(), all_latencies.end()) / 1e6,
+                worst_p99,
+                static_cast<unsigned long long>(stats.wakeups));
+}
+
+std::vector<int> parse_counts(std::string_view list)
+{
+    std::vector<int> ret;
+
+    while (!list.empty()) {
+        auto const comma = list.find(',');
+        auto const item = std::string{list.substr(0, comma)};
+        ret.push_back(std::max(1, std::atoi(item.c_str())));
+
+        if (comma == std::string_view::npos)
+            break;
+
+        list.remove_prefix(comma + 1);
+    }
+
+    return ret;
+}
+
+[[noreturn]] void usage()
+{
+    std::cerr << "usage: gd100-stress [--terminals 1,8,32,64] [--seconds 5]"
+                 " [--backend epoll|io_uring] [--producer mixed|steady|bursty|idle]"
+                 " [--transport pty|pipe] [--read-buffer adaptive|fixed]\n";
+    std::exit(EXIT_FAILURE);
+}
+
+options parse_options(int const argc, char** const argv)
+{
+    options ret;
+
+    for (int i = 1; i < argc; ++i) {
+        auto const name = std::string_view{argv[i]};
+        if (i + 1 == argc)
+            usage();
+
+        auto const value = std::string_view{argv[++i]};
+
+        if (name == "--terminals") {
+            ret.terminal_counts = parse_counts(value);
+        } else if (name == "--seconds") {
+            ret.duration = std::chrono::seconds{std::max(1, std::atoi(argv[i]))};
+        } else if (name == "--backend") {
+            if (value == "io_uring")
+                ret.backend = gd100::io_backend::io_uring;
+            else if (value != "epoll")
+                usage();
+        } else if (name == "--producer") {
+            if (value == "steady")
+                ret.producer = producer_kind::steady;
+            else if (value == "bursty")
+                ret.producer = producer_kind::bursty;
+            else if (value == "idle")
+                ret.producer = producer_kind::idle;
+            else if (value != "mixed")
+                usage();
+        } else if (name == "--transport") {
+            if (value == "pipe")
+                ret.channel = transport::pipe;
+            else if (value != "pty")
+                usage();
+        } else if (name == "--read-buffer") {
+            if (value == "fixed")
+                ret.growing_buffers = false;
+            else if (value != "adaptive")
+                usage();
+        } else {
+            usage();
+        }
+    }
+
+    if (ret.terminal_counts.empty())
+        usage();
+
+    return ret;
+}
+
+} // ::
+
+int main(int argc, char** argv)
+{
+    auto const opts = parse_options(argc, argv);
+
+    std::printf("producers: %s, transport: %s, read buffer: %s, %lld s per run\n",
+                opts.producer ? producer_name(*opts.producer) : "mixed",
+                opts.channel == transport::pty ? "pty" : "pipe",
+                opts.growing_buffers ? "adaptive" : "fixed",
+                static_cast<long long>(opts.duration.count()));
+
+    std::printf("%5s %8s %9s %12s %8s %8s %9s %8s %8s %8s %8s %9s %10s\n",
+                "N", "MB/s", "cpu ms/MB", "decode ms/MB", "reads/MB", "polls/MB", "chunks/MB", "p50 ms", "p90 ms", "p99 ms", "max ms", "worst p99", "wakeups");
+
+    for (auto const count : opts.terminal_counts)
+        run(opts, count);
+
+    return EXIT_SUCCESS;
+}
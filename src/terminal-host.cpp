@@ -0,0 +1,339 @@
+// Out-of-process terminal host.
+//
+// Owns the pseudoterminals and katerm terminals on behalf of the Godot module
+// and publishes frames through a shared memory ring, so decoding happens
+// outside the game process and starting a shell doesn't fork the game.  See
+// host_protocol.hpp for how the two sides talk to each other.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include <katerm/terminal.hpp>
+
+#include "tracking_decoder.hpp"
+#include "frame_encoder.hpp"
+#include "frame_ring.hpp"
+#include "frame_wire.hpp"
+#include "graphics_filter.hpp"
+#include "host_protocol.hpp"
+#include "output_throttle.hpp"
+#include "program.hpp"
+#include "program_terminal_manager.hpp"
+#include "pty_process.hpp"
+#include "trace.hpp"
+
+namespace {
+
+constexpr std::size_t ring_capacity = 8 * 1024 * 1024;
+
+// Where all terminals publish their records.  Only used from the manager's
+// controller thread so there's a single producer.
+class host_output {
+public:
+    host_output()
+        : ring{gd100::frame_ring::create(ring_capacity)}
+        , event_descriptor{eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)}
+    {
+        if (event_descriptor < 0)
+            throw std::runtime_error{"Couldn't create ring eventfd."};
+    }
+
+    ~host_output()
+    {
+        close(event_descriptor);
+    }
+
+    bool publish(gd100::host_record_kind const kind, std::vector<char> const& record)
+    {
+        auto const pushed = ring.push(static_cast<gd100::frame_ring::record_kind>(kind),
+                                      record.data(), record.size());
+
+        if (pushed) {
+            std::uint64_t const one = 1;
+            write(event_descriptor, &one, sizeof(one));
+        }
+
+        return pushed;
+    }
+
+    gd100::frame_ring ring;
+    int event_descriptor;
+};
+
+// Set by a redraw request on the main thread, see host_request.
+using redraw_flag = std::shared_ptr<std::atomic<bool>>;
+
+class host_terminal_program : public gd100::program {
+public:
+    host_terminal_program(std::uint32_t const i, katerm::extend const size, int const md,
+                          host_output& o, redraw_flag r)
+        : id{i}
+        , terminal{size}
+        , master_descriptor{md}
+        , output{o}
+        , redraw{std::move(r)}
+    {
+    }
+
+    // The module has its own copy of the master, the shell sees a hang up
+    // once both are closed.
+    ~host_terminal_program()
+    {
+        close(master_descriptor);
+    }
+
+    void handle_bytes(const char* bytes, std::size_t const count, bool const more_data_coming) override
+    {
+        auto const now = clock::now();
+
+        if (redraw->exchange(false)) {
+            encoder.reset();
+            graphics.reset();
+        }
+
+        flush_frame(bytes, count, more_data_coming, now);
+        publish_exit(now);
+    }
+
+    clock::time_point flush_deadline() override
+    {
+        if (*redraw)
+            return clock::time_point::min();
+
+        return std::min({throttle.deadline(), retry_at, exit_retry_at});
+    }
+
+    void handle_exit(gd100::process_exit const& exit_info) override
+    {
+        gd100::write_exit(exit_info, begin_record());
+        exit_record = record;
+        publish_exit(clock::now());
+    }
+
+private:
+    void flush_frame(const char* bytes, std::size_t const count, bool const more_data_coming,
+                     clock::time_point const now)
+    {
+        throttle.record_bytes(count, now);
+
+        {
+            auto const span = gd100::trace_span{"decode"};
+            graphics.feed(bytes, count, terminal, decoder);
+        }
+
+        if (auto const responses = graphics.take_responses(); !responses.empty())
+            write(master_descriptor, responses.data(), responses.size());
+
+        if (more_data_coming || !throttle.should_flush(now))
+            return;
+
+        throttle.flushed(now);
+
+        auto frame = encoder.encode(terminal, decoder.cursor());
+        graphics.take_updates(frame);
+
+        if (frame.empty()) {
+            terminal.screen.clear_changes();
+            retry_at = clock::time_point::max();
+            return;
+        }
+
+        gd100::write_frame(frame, begin_record());
+        if (output.publish(gd100::host_record_kind::frame, record)) {
+            terminal.screen.clear_changes();
+            retry_at = clock::time_point::max();
+        } else {
+            // The client isn't keeping up.  What it has on screen is no longer
+            // known, so send everything once there's room again.
+            encoder.reset();
+            retry_at = now + std::chrono::milliseconds{16};
+
+            // Images that could never fit in the ring are given up on.
+            if (record.size() <= ring_capacity / 2)
+                graphics.restore_updates(frame);
+            else
+                std::cerr << "gd100-terminal-host: dropping images too large for the frame ring.\n";
+        }
+    }
+
+    // The exit record is the last thing the client hears about a terminal,
+    // it's kept until it fits in the ring and waits for a frame that's being
+    // retried so it doesn't overtake it.
+    void publish_exit(clock::time_point const now)
+    {
+        if (exit_record.empty() || retry_at != clock::time_point::max())
+            return;
+
+        if (output.publish(gd100::host_record_kind::exit, exit_record)) {
+            exit_record.clear();
+            exit_retry_at = clock::time_point::max();
+        } else {
+            exit_retry_at = now + std::chrono::milliseconds{16};
+        }
+    }
+
+    // Every record starts with the terminal id, see host_record_kind.
+    std::vector<char>& begin_record()
+    {
+        auto const id_bytes = reinterpret_cast<char const*>(&id);
+
+        record.assign(id_bytes, id_bytes + sizeof(id));
+        return record;
+    }
+
+    std::uint32_t id;
+    katerm::terminal terminal;
+    int master_descriptor;
+    gd100::tracking_decoder decoder;
+    gd100::frame_encoder encoder;
+    gd100::graphics_filter graphics;
+    gd100::output_throttle throttle;
+    clock::time_point retry_at = clock::time_point::max();
+    clock::time_point exit_retry_at = clock::time_point::max();
+
+    host_output& output;
+    redraw_flag redraw;
+    std::vector<char> record;
+    std::vector<char> exit_record; // Empty unless an exit waits for room
+};
+
+// A shell and a pidfd for signalling it.  The manager reaps the shell once
+// it exits, after that its pid may belong to an unrelated process but the
+// pidfd still refers to the shell.
+struct host_child {
+    gd100::pty_process process;
+    int pidfd;
+    redraw_flag redraw;
+};
+
+// Opened before the manager watches the process, nothing can have reaped it
+// yet.  Not every libc exposes pidfd_open yet, so go through syscall.
+int open_pidfd(pid_t const pid)
+{
+    auto const pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    if (pidfd < 0)
+        throw std::runtime_error{"Couldn't open a pidfd for the shell."};
+
+    fcntl(pidfd, F_SETFD, FD_CLOEXEC);
+    return pidfd;
+}
+
+void hang_up(host_child const& child)
+{
+    syscall(SYS_pidfd_send_signal, child.pidfd, SIGHUP, nullptr, 0);
+    close(child.pidfd);
+}
+
+} // ::
+
+int main()
+{
+    auto const control = gd100::host_control_descriptor;
+
+    host_output output;
+    gd100::program_terminal_manager manager{gd100::io_backend_from_environment()};
+
+    int const shared_descriptors[]{output.ring.memory_descriptor(), output.event_descriptor};
+    auto const hello = gd100::host_hello{gd100::host_protocol_version};
+    if (!gd100::send_message(control, &hello, sizeof(hello), shared_descriptors, 2)) {
+        std::cerr << "gd100-terminal-host: must be started by the Godot module.\n";
+        return EXIT_FAILURE;
+    }
+
+    std::unordered_map<std::uint32_t, host_child> children;
+
+    gd100::host_request request;
+    int unused[1];
+    while (gd100::receive_message(control, &request, sizeof(request), unused, 0)) {
+        switch (request.type) {
+            case gd100::host_request_type::spawn: {
+                auto const size = katerm::extend{request.width, request.height};
+
+                auto reply = gd100::host_spawn_reply{request.terminal, -1};
+                try {
+                    auto const process = gd100::spawn_shell(size);
+                    auto const child = host_child{
+                        process, open_pidfd(process.pid), std::make_shared<std::atomic<bool>>(false)};
+                    try {
+                        manager.register_program(
+                            process.master_descriptor,
+                            process.pid,
+                            std::make_unique<host_terminal_program>(
+                                request.terminal, size, process.master_descriptor, output,
+                                child.redraw));
+                    } catch (...) {
+                        hang_up(child);
+                        throw;
+                    }
+
+                    children[request.terminal] = child;
+                    reply.pid = process.pid;
+
+                    gd100::send_message(control, &reply, sizeof(reply), &process.master_descriptor, 1);
+                } catch (std::exception const& e) {
+                    std::cerr << "gd100-terminal-host: " << e.what() << '\n';
+                    gd100::send_message(control, &reply, sizeof(reply), nullptr, 0);
+                }
+
+                break;
+            }
+
+            case gd100::host_request_type::close: {
+                auto const it = children.find(request.terminal);
+                if (it != children.end()) {
+                    manager.remove_program(it->second.process.master_descriptor);
+                    hang_up(it->second);
+                    children.erase(it);
+                }
+
+                break;
+            }
+
+            case gd100::host_request_type::focus: {
+                auto const it = children.find(request.terminal);
+                if (it != children.end())
+                    manager.set_focused(it->second.process.master_descriptor, request.width != 0);
+
+                break;
+            }
+
+            case gd100::host_request_type::redraw: {
+                auto const it = children.find(request.terminal);
+                if (it != children.end()) {
+                    *it->second.redraw = true;
+                    manager.recheck_deadlines();
+                }
+
+                break;
+            }
+        }
+    }
+
+    // The module closed its end, which means the game exited or crashed.
+    for (auto const& [terminal, child] : children)
+        hang_up(child);
+
+    // Decoding happens in this process, so with GD100_TRACE set its spans
+    // are written to the working directory on the way out.
+    if (gd100::tracing_enabled()) {
+        auto const path = "gd100-terminal-host-" + std::to_string(getpid()) + ".trace.json";
+        gd100::write_trace(path.c_str());
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+#include "byte_stream.hpp"
+#include "terminal_snapshot.hpp"
+#include "text_extraction.hpp"
+
+namespace gd100 {
+
+namespace {
+
+// Upper bound on the dimensions accepted from a snapshot.
+constexpr std::int32_t max_snapshot_extend = 4096;
+
+using terminal_mode = decltype(katerm::terminal::mode);
+using terminal_cursor = decltype(katerm::terminal::cursor);
+using mouse_mode = decltype(katerm::terminal::mouse);
+
+// The mode, cursor and mouse mode are saved as katerm stores them.  Their
+// sizes go into the snapshot so one taken with a different katerm is
+// rejected instead of misread.
+static_assert(std::is_trivially_copyable_v<terminal_mode>);
+static_assert(std::is_trivially_copyable_v<terminal_cursor>);
+static_assert(std::is_trivially_copyable_v<mouse_mode>);
+
+constexpr std::uint32_t state_sizes[]{
+    sizeof(terminal_mode),
+    sizeof(terminal_cursor),
+    sizeof(mouse_mode),
+};
+
+struct attribute {
+    katerm::glyph_attr_bit bit;
+    int sgr;
+};
+
+// Attributes that are saved, bit i of a saved style is attributes[i].
+constexpr attribute attributes[]{
+    {katerm::glyph_attr_bit::bold, 1},
+    {katerm::glyph_attr_bit::faint, 2},
+    {katerm::glyph_attr_bit::italic, 3},
+    {katerm::glyph_attr_bit::underline, 4},
+    {katerm::glyph_attr_bit::blink, 5},
+    {katerm::glyph_attr_bit::reversed, 7},
+    {katerm::glyph_attr_bit::invisible, 8},
+    {katerm::glyph_attr_bit::struck, 9},
+};
+
+struct saved_style {
+    std::uint32_t fg;
+    std::uint32_t bg;
+    std::uint16_t attrs;
+
+    bool operator==(saved_style const&) const = default;
+};
+
+struct saved_style_hash {
+    std::size_t operator()(saved_style const& s) const noexcept
+    {
+        return std::hash<std::uint64_t>{}(std::uint64_t{s.fg} << 32 | s.bg) ^ s.attrs;
+    }
+};
+
+saved_style save_style(katerm::glyph_style const& style)
+{
+    std::uint16_t attrs = 0;
+    for (std::size_t i = 0; i != std::size(attributes); ++i) {
+        if (style.mode.is_set(attributes[i].bit))
+            attrs |= 1 << i;
+    }
+
+    return {to_u32(style.fg), to_u32(style.bg), attrs};
+}
+
+// to_u32 packs a colour as 0xRRGGBBAA, the layout Godot's Color(int) takes.
+void append_colour(std::string& out, int const selector, std::uint32_t const colour)
+{
+    out += ';';
+    out += std::to_string(selector);
+    out += ";2;";
+    out += std::to_string(colour >> 24 & 0xff);
+    out += ';';
+    out += std::to_string(colour >> 16 & 0xff);
+    out += ';';
+    out += std::to_string(colour >> 8 & 0xff);
+}
+
+void append_sgr(std::string& out, saved_style const& style)
+{
+    out += "\x1b[0";
+
+    for (std::size_t i = 0; i != std::size(attributes); ++i) {
+        if (style.attrs & (1 << i)) {
+            out += ';';
+            out += std::to_string(attributes[i].sgr);
+        }
+    }
+
+    append_colour(out, 38, style.fg);
+    append_colour(out, 48, style.bg);
+    out += 'm';
+}
+
+void append_private_mode(std::string& out, int const mode, bool const set)
+{
+    out += "\x1b[?";
+    out += std::to_string(mode);
+    out += set ? 'h' : 'l';
+}
+
+} // ::
+
+std::vector<char> save_snapshot(katerm::terminal const& term, cursor_style const& style)
+{
+    auto const size = term.screen.size();
+
+    std::vector<saved_style> styles;
+    std::unordered_map<saved_style, std::uint16_t, saved_style_hash> style_indices;
+
+    std::vector<std::uint32_t> codes;
+    std::vector<std::uint16_t> cell_styles;
+    codes.reserve(static_cast<std::size_t>(size.width) * size.height);
+    cell_styles.reserve(codes.capacity());
+
+    for (int row = 0; row != size.height; ++row) {
+        for (int column = 0; column != size.width; ++column) {
+            auto const glyph = term.screen.get_glyph({column, row});
+
+            // The second half of a wide character is recreated by writing the
+            // first half.
+            if (glyph.style.mode.is_set(katerm::glyph_attr_bit::wide_dummy)) {
+                codes.push_back(0xffffffff);
+                cell_styles.push_back(0);
+                continue;
+            }
+
+            auto const saved = save_style(glyph.style);
+            auto [it, inserted] = style_indices.try_emplace(saved, static_cast<std::uint16_t>(styles.size()));
+            if (inserted) {
+                // Only possible on very large screens with truecolour
+                // gradients, a snapshot with wrong colours would be worse
+                // than none.
+                if (styles.size() == 0xffff)
+                    throw std::runtime_error{"Too many distinct styles to save the terminal."};
+
+                styles.push_back(saved);
+            }
+
+            codes.push_back(glyph.code);
+            cell_styles.push_back(it->second);
+        }
+    }
+
+    std::vector<char> out;
+    writer w{out};
+
+    w.put<std::uint32_t>(snapshot_magic);
+    w.put<std::uint32_t>(snapshot_version);
+    w.put<std::int32_t>(size.width);
+    w.put<std::int32_t>(size.height);
+
+    for (auto const state_size : state_sizes)
+        w.put(state_size);
+
+    w.put(term.mode);
+    w.put(term.cursor);
+    w.put(term.mouse);
+
+    w.put<std::uint8_t>(static_cast<std::uint8_t>(style.shape));
+    w.put<std::uint8_t>(style.blinking);
+    w.put<std::uint8_t>(style.visible);
+
+    w.put<std::uint32_t>(styles.size());
+    for (auto const& s : styles) {
+        w.put(s.fg);
+        w.put(s.bg);
+        w.put(s.attrs);
+    }
+
+    w.put_bytes(codes.data(), codes.size() * sizeof(codes[0]));
+    w.put_bytes(cell_styles.data(), cell_styles.size() * sizeof(cell_styles[0]));
+
+    return out;
+}
+
+bool restore_snapshot(
+        char const* const data,
+        std::size_t const size,
+        katerm::terminal& term,
+        tracking_decoder& decoder)
+{
+    reader r{data, size};
+
+    std::uint32_t magic, version, style_count;
+    std::int32_t width, height;
+
+    if (!r.get(magic) || magic != snapshot_magic
+        || !r.get(version) || version != snapshot_version
+        || !r.get(width) || !r.get(height))
+        return false;
+
+    for (auto const state_size : state_sizes) {
+        std::uint32_t saved_size;
+        if (!r.get(saved_size) || saved_size != state_size)
+            return false;
+    }
+
+    terminal_mode mode;
+    terminal_cursor cursor;
+    mouse_mode mouse;
+    std::uint8_t shape, blinking, visible;
+
+    if (!r.get(mode) || !r.get(cursor) || !r.get(mouse)
+        || !r.get(shape) || !r.get(blinking) || !r.get(visible)
+        || !r.get(style_count))
+        return false;
+
+    if (width <= 0 || height <= 0 || width > max_snapshot_extend || height > max_snapshot_extend)
+        return false;
+
+    std::vector<saved_style> styles(style_count);
+    for (auto& s : styles) {
+        if (!r.get(s.fg) || !r.get(s.bg) || !r.get(s.attrs))
+            return false;
+    }
+
+    auto const cell_count = static_cast<std::size_t>(width) * height;
+    std::vector<std::uint32_t> codes(cell_count);
+    std::vector<std::uint16_t> cell_styles(cell_count);
+
+    if (!r.get_bytes(codes.data(), cell_count * sizeof(codes[0]))
+        || !r.get_bytes(cell_styles.data(), cell_count * sizeof(cell_styles[0])))
+        return false;
+
+    if (std::any_of(cell_styles.begin(), cell_styles.end(),
+                    [&](auto const index) { return index >= styles.size() && !styles.empty(); }))
+        return false;
+
+    auto const term_size = term.screen.size();
+    auto const rows = std::min(height, term_size.height);
+    auto const columns = std::min(width, term_size.width);
+
+    // Start from a full reset so modes from before the restore don't leak
+    // into it.
+    std::string redraw = "\x1b" "c";
+    redraw.reserve(cell_count * 2);
+
+    std::optional<std::uint16_t> current_style;
+
+    for (int row = 0; row != rows; ++row) {
+        redraw += "\x1b[";
+        redraw += std::to_string(row + 1);
+        redraw += ";1H";
+
+        for (int column = 0; column != columns; ++column) {
+            auto const index = static_cast<std::size_t>(row) * width + column;
+            if (codes[index] == 0xffffffff)
+                continue;
+
+            if (!styles.empty() && cell_styles[index] != current_style) {
+                current_style = cell_styles[index];
+                append_sgr(redraw, styles[*current_style]);
+            }
+
+            append_utf8(redraw, static_cast<char32_t>(codes[index]));
+        }
+    }
+
+    // DECSCUSR counts blinking and steady variants of each shape from 1.
+    auto const shape_number = std::min<int>(shape, 2) * 2 + (blinking ? 1 : 2);
+    redraw += "\x1b[";
+    redraw += std::to_string(shape_number);
+    redraw += " q";
+
+    append_private_mode(redraw, 25, visible);
+
+    katerm::terminal_instructee t{&term};
+    decoder.decode(redraw.data(), redraw.size(), t);
+
+    // The redraw left its own pen and modes behind, the saved ones replace
+    // them.  The cells were drawn on whichever screen is current, if the
+    // snapshot was taken on the alternate screen the other one comes back
+    // empty.
+    term.mode = mode;
+    term.cursor = cursor;
+    term.mouse = mouse;
+    term.cursor.pos.x = std::clamp(term.cursor.pos.x, 0, term_size.width - 1);
+    term.cursor.pos.y = std::clamp(term.cursor.pos.y, 0, term_size.height - 1);
+
+    return true;
+}
+
+} // gd100::
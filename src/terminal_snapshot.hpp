@@ -0,0 +1,53 @@
+#ifndef GDTERM_TERMINAL_SNAPSHOT_HPP
+#define GDTERM_TERMINAL_SNAPSHOT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <katerm/terminal.hpp>
+
+#include "tracking_decoder.hpp"
+
+namespace gd100 {
+
+// Saved terminal state for persisting a console across level loads and save
+// games.
+//
+// The snapshot holds the cells with their colours and attributes, the cursor
+// style, and katerm's mode bits, cursor (with its pen) and mouse mode copied
+// as katerm stores them.  Restoring doesn't replay the original output, the
+// cells are drawn by a single synthesized redraw through the decoder, which
+// is as long as the screen regardless of how much output produced it.  The
+// mode, cursor and mouse mode are then assigned directly.
+//
+// Still lost, because katerm doesn't make them public:
+//  - the scroll region, tab stops, character sets and the saved cursor
+//  - the contents of the screen that isn't current, only the visible one is
+//    saved
+//  - palette indices, cells come back with the colour the index had at the
+//    time, so a later set_palette doesn't change them
+//  - images placed by sixel or kitty graphics
+
+constexpr std::uint32_t snapshot_magic = 0x31534447; // "GDS1"
+
+// Bumped whenever the layout changes, older snapshots are rejected.  Changes
+// to katerm's types that keep their size need a bump too.
+constexpr std::uint32_t snapshot_version = 2;
+
+// Throws when the screen has more distinct styles than a snapshot can hold,
+// 2^16 - 1 of them.
+std::vector<char> save_snapshot(katerm::terminal const& term, cursor_style const& style);
+
+// Returns false and leaves the terminal alone when the data isn't a snapshot
+// of this version and katerm build.  A snapshot of a different size is clipped to the
+// terminal.
+bool restore_snapshot(
+        char const* data,
+        std::size_t size,
+        katerm::terminal& term,
+        tracking_decoder& decoder);
+
+} // gd100::
+
+#endif // header guard
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <utility>
+
+#include "text_extraction.hpp"
+
+namespace gd100 {
+
+void append_utf8(std::string& out, char32_t code)
+{
+    // Cleared cells have no code point.
+    if (code == 0)
+        code = ' ';
+
+    if (code > 0x10ffff || (code >= 0xd800 && code <= 0xdfff))
+        code = 0xfffd;
+
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xc0 | code >> 6);
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+        out += static_cast<char>(0xe0 | code >> 12);
+        out += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    } else {
+        out += static_cast<char>(0xf0 | code >> 18);
+        out += static_cast<char>(0x80 | (code >> 12 & 0x3f));
+        out += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    }
+}
+
+namespace {
+
+bool is_wrapped(katerm::terminal const& term, int const row, int const width)
+{
+    auto const last = term.screen.get_glyph({width - 1, row});
+    return last.style.mode.is_set(katerm::glyph_attr_bit::wrap);
+}
+
+// Appends columns [first, last] of row.
+void append_cells(
+        std::string& out,
+        katerm::terminal const& term,
+        int const row,
+        int const first,
+        int const last,
+        bool const trim)
+{
+    auto const row_start = out.size();
+
+    for (int column = first; column <= last; ++column) {
+        auto const glyph = term.screen.get_glyph({column, row});
+
+        // The second half of a wide character, the first half has the code.
+        if (glyph.style.mode.is_set(katerm::glyph_attr_bit::wide_dummy))
+            continue;
+
+        append_utf8(out, glyph.code);
+    }
+
+    if (trim) {
+        auto const end = out.find_last_not_of(' ');
+        out.resize(end == std::string::npos || end < row_start ? row_start : end + 1);
+    }
+}
+
+} // ::
+
+std::string extract_text(
+        katerm::terminal const& term,
+        katerm::position start,
+        katerm::position end,
+        int const options)
+{
+    auto const size = term.screen.size();
+    if (size.width == 0 || size.height == 0)
+        return {};
+
+    auto const clamp = [&](katerm::position& p) {
+        p.x = std::clamp(p.x, 0, size.width - 1);
+        p.y = std::clamp(p.y, 0, size.height - 1);
+    };
+
+    clamp(start);
+    clamp(end);
+
+    auto const trim = (options & text_trim_trailing_spaces) != 0;
+    std::string out;
+
+    if (options & text_rectangular) {
+        auto const left = std::min(start.x, end.x);
+        auto const right = std::max(start.x, end.x);
+        auto const top = std::min(start.y, end.y);
+        auto const bottom = std::max(start.y, end.y);
+
+        out.reserve(static_cast<std::size_t>(right - left + 2) * (bottom - top + 1));
+
+        for (int row = top; row <= bottom; ++row) {
+            append_cells(out, term, row, left, right, trim);
+            if (row != bottom)
+                out += '\n';
+        }
+
+        return out;
+    }
+
+    if (std::pair{start.y, start.x} > std::pair{end.y, end.x})
+        std::swap(start, end);
+
+    auto const join_wrapped = (options & text_join_wrapped_lines) != 0;
+
+    out.reserve(static_cast<std::size_t>(size.width + 1) * (end.y - start.y + 1));
+
+    for (int row = start.y; row <= end.y; ++row) {
+        auto const first = row == start.y ? start.x : 0;
+        auto const last = row == end.y ? end.x : size.width - 1;
+
+        // Spaces at the end of a wrapped row are part of the text that
+        // continues on the next one.
+        auto const joined = join_wrapped && row != end.y && is_wrapped(term, row, size.width);
+
+        append_cells(out, term, row, first, last, trim && !joined);
+
+        if (row != end.y && !joined)
+            out += '\n';
+    }
+
+    return out;
+}
+
+std::string extract_line_text(katerm::terminal const& term, int const row)
+{
+    auto const size = term.screen.size();
+    if (row < 0 || row >= size.height)
+        return {};
+
+    std::string out;
+    out.reserve(size.width);
+    append_cells(out, term, row, 0, size.width - 1, true);
+    return out;
+}
+
+} // gd100::
@@ -0,0 +1,40 @@
+#ifndef GDTERM_TEXT_EXTRACTION_HPP
+#define GDTERM_TEXT_EXTRACTION_HPP
+
+#include <string>
+
+#include <katerm/terminal.hpp>
+
+namespace gd100 {
+
+// Flags for extract_text, the values are part of the GDScript API.
+enum text_option : int {
+    // Take the same columns from every row instead of following the text
+    // from start to end.
+    text_rectangular = 1 << 0,
+
+    text_trim_trailing_spaces = 1 << 1,
+
+    // Rows that were wrapped by the terminal are joined without a newline.
+    // Only applies to stream selections.
+    text_join_wrapped_lines = 1 << 2,
+};
+
+// Appends the code point of a cell as UTF-8.  Cleared cells become a space and
+// invalid code points U+FFFD.
+void append_utf8(std::string& out, char32_t code);
+
+// UTF-8 text of the cells between start and end, both inclusive and in
+// either order.  Positions outside the screen are clamped.
+std::string extract_text(
+        katerm::terminal const& term,
+        katerm::position start,
+        katerm::position end,
+        int options);
+
+// UTF-8 text of a single row without trailing spaces.
+std::string extract_line_text(katerm::terminal const& term, int row);
+
+} // gd100::
+
+#endif // header guard
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "trace.hpp"
+
+namespace gd100 {
+
+namespace detail {
+std::atomic<bool> tracing = std::getenv("GD100_TRACE") != nullptr;
+} // detail::
+
+namespace {
+
+constexpr std::uint64_t spans_per_thread = 1 << 16;
+
+// The fields are relaxed atomics because write_trace may read a slot while
+// its thread overwrites it.  Those spans are recognised with the counters in
+// span_buffer and dropped.
+struct span_slot {
+    std::atomic<char const*> name;
+    std::atomic<std::int32_t> thread_id;
+    std::atomic<std::int64_t> start;    // ns on the steady clock
+    std::atomic<std::int64_t> duration; // ns
+};
+
+// Written by one thread at a time like a seqlock: started is bumped before a
+// slot is written and finished after.
+struct span_buffer {
+    std::unique_ptr<span_slot[]> slots{new span_slot[spans_per_thread]};
+    std::atomic<std::uint64_t> started = 0;
+    std::atomic<std::uint64_t> finished = 0;
+
+    // Cleared when the owning thread exits so another thread can take the
+    // buffer over, threads like the manager's controller come and go.
+    std::atomic<bool> in_use = true;
+};
+
+std::mutex buffers_mutex;
+std::vector<std::unique_ptr<span_buffer>> buffers; // guarded by buffers_mutex
+
+struct buffer_owner {
+    span_buffer* buffer = nullptr;
+    std::int32_t thread_id = 0;
+
+    ~buffer_owner()
+    {
+        if (buffer)
+            buffer->in_use.store(false, std::memory_order_release);
+    }
+};
+
+thread_local buffer_owner owner;
+
+buffer_owner& thread_owner()
+{
+    if (owner.buffer)
+        return owner;
+
+    owner.thread_id = static_cast<std::int32_t>(syscall(SYS_gettid));
+
+    auto lock = std::scoped_lock{buffers_mutex};
+
+    for (auto const& buffer : buffers) {
+        if (!buffer->in_use.load(std::memory_order_acquire)) {
+            buffer->in_use.store(true, std::memory_order_relaxed);
+            owner.buffer = buffer.get();
+            return owner;
+        }
+    }
+
+    owner.buffer = buffers.emplace_back(std::make_unique<span_buffer>()).get();
+    return owner;
+}
+
+std::int64_t to_ns(std::chrono::steady_clock::duration const d)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+
+struct span {
+    char const* name;
+    std::int32_t thread_id;
+    std::int64_t start;
+    std::int64_t duration;
+};
+
+void collect_spans(span_buffer const& buffer, std::vector<span>& out)
+{
+    auto const finished = buffer.finished.load(std::memory_order_acquire);
+    auto const first = finished > spans_per_thread ? finished - spans_per_thread : 0;
+    auto const begin = out.size();
+
+    for (auto i = first; i != finished; ++i) {
+        auto const& slot = buffer.slots[i % spans_per_thread];
+        out.push_back({
+            slot.name.load(std::memory_order_relaxed),
+            slot.thread_id.load(std::memory_order_relaxed),
+            slot.start.load(std::memory_order_relaxed),
+            slot.duration.load(std::memory_order_relaxed),
+        });
+    }
+
+    // Slots the thread started overwriting while we copied them can be torn.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    auto const started = buffer.started.load(std::memory_order_relaxed);
+    auto const valid_from = started > spans_per_thread ? started - spans_per_thread : 0;
+
+    if (valid_from > first) {
+        auto const torn = std::min(valid_from - first, finished - first);
+        out.erase(out.begin() + begin, out.begin() + begin + torn);
+    }
+}
+
+} // ::
+
+void set_tracing(bool const enabled) noexcept
+{
+    detail::tracing.store(enabled, std::memory_order_relaxed);
+}
+
+void record_span(char const* const name,
+                 std::chrono::steady_clock::time_point const start,
+                 std::chrono::steady_clock::time_point const end) noexcept
+{
+    auto const& o = thread_owner();
+    auto& buffer = *o.buffer;
+
+    auto const index = buffer.finished.load(std::memory_order_relaxed);
+    buffer.started.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    auto& slot = buffer.slots[index % spans_per_thread];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.thread_id.store(o.thread_id, std::memory_order_relaxed);
+    slot.start.store(to_ns(start.time_since_epoch()), std::memory_order_relaxed);
+    slot.duration.store(to_ns(end - start), std::memory_order_relaxed);
+
+    buffer.finished.store(index + 1, std::memory_order_release);
+}
+
+bool write_trace(char const* const path)
+{
+    std::vector<span> spans;
+
+    {
+        auto lock = std::scoped_lock{buffers_mutex};
+        for (auto const& buffer : buffers)
+            collect_spans(*buffer, spans);
+    }
+
+    auto const file = std::fopen(path, "w");
+    if (!file)
+        return false;
+
+    auto const pid = static_cast<int>(getpid());
+
+    // Complete events ("ph": "X"), timestamps are in microseconds.
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+
+    auto first = true;
+    for (auto const& s : spans) {
+        std::fprintf(file,
+            "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            first ? "" : ",",
+            s.name, pid, static_cast<int>(s.thread_id),
+            s.start / 1000.0, s.duration / 1000.0);
+
+        first = false;
+    }
+
+    std::fputs("\n]}\n", file);
+
+    auto const write_failed = std::ferror(file);
+    return std::fclose(file) == 0 && !write_failed;
+}
+
+} // gd100::
@@ -0,0 +1,64 @@
+#ifndef GDTERM_TRACE_HPP
+#define GDTERM_TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+
+namespace gd100 {
+
+// Opt-in span tracing, enabled by setting the GD100_TRACE environment
+// variable or calling set_tracing.
+//
+// Every thread records into its own fixed size ring buffer without taking a
+// lock, old spans are overwritten once it's full.  write_trace dumps what's
+// in the buffers in the Chrome trace event format, which chrome://tracing and
+// Perfetto open directly.
+
+namespace detail {
+extern std::atomic<bool> tracing;
+} // detail::
+
+inline bool tracing_enabled() noexcept
+{
+    return detail::tracing.load(std::memory_order_relaxed);
+}
+
+void set_tracing(bool enabled) noexcept;
+
+// Records a span on the calling thread.  name must have static storage
+// duration, only the pointer is stored.
+void record_span(char const* name,
+                 std::chrono::steady_clock::time_point start,
+                 std::chrono::steady_clock::time_point end) noexcept;
+
+// Writes the spans of all threads to path, returns false if the file
+// couldn't be written.
+bool write_trace(char const* path);
+
+// Records the span from construction to destruction when tracing is enabled.
+class trace_span {
+public:
+    explicit trace_span(char const* const n) noexcept
+        : name{tracing_enabled() ? n : nullptr}
+    {
+        if (name)
+            start = std::chrono::steady_clock::now();
+    }
+
+    trace_span(trace_span const&)=delete;
+    trace_span& operator=(trace_span const&)=delete;
+
+    ~trace_span()
+    {
+        if (name)
+            record_span(name, start, std::chrono::steady_clock::now());
+    }
+
+private:
+    char const* name;
+    std::chrono::steady_clock::time_point start;
+};
+
+} // gd100::
+
+#endif // header guard
@@ -0,0 +1,222 @@
+#include <algorithm>
+
+#include "tracking_decoder.hpp"
+
+namespace gd100 {
+
+namespace {
+
+constexpr unsigned char esc = 0x1b;
+constexpr unsigned char bel = 0x07;
+constexpr unsigned char can = 0x18;
+constexpr unsigned char sub = 0x1a;
+
+// Reads a decimal parameter, an empty one is 0.  Returns where it stopped.
+char const* parse_parameter(char const* it, char const* const end, int& value)
+{
+    value = 0;
+    for (; it != end && *it >= '0' && *it <= '9'; ++it)
+        value = std::min(value * 10 + (*it - '0'), 9999);
+
+    return it;
+}
+
+} // ::
+
+tracking_decoder::sequence_state tracking_decoder::after_escape(unsigned char const byte)
+{
+    switch (byte) {
+        case '[':
+            return sequence_state::control_sequence;
+
+        case ']': case 'P': case '_': case '^': case 'X':
+            return sequence_state::control_string;
+    }
+
+    if (byte >= 0x20 && byte <= 0x2f)
+        return sequence_state::escape_intermediate;
+
+    if (byte >= 0x30 && byte <= 0x7e)
+        return sequence_state::ground;
+
+    // C0 controls are executed without interrupting the sequence.
+    return sequence_state::escape;
+}
+
+tracking_decoder::sequence_state tracking_decoder::next_state(
+        sequence_state const state,
+        unsigned char const byte)
+{
+    if (byte == can || byte == sub)
+        return sequence_state::ground;
+
+    switch (state) {
+        case sequence_state::ground:
+        case sequence_state::ground_c2:
+            if (byte == esc)
+                return sequence_state::escape;
+
+            if (state == sequence_state::ground_c2) {
+                switch (byte) {
+                    case 0x9b:
+                        return sequence_state::control_sequence;
+
+                    case 0x90: case 0x98: case 0x9d: case 0x9e: case 0x9f:
+                        return sequence_state::control_string;
+                }
+            }
+
+            return byte == 0xc2 ? sequence_state::ground_c2 : sequence_state::ground;
+
+        case sequence_state::escape:
+            if (byte == esc)
+                return sequence_state::escape;
+
+            return after_escape(byte);
+
+        case sequence_state::escape_intermediate:
+            if (byte == esc)
+                return sequence_state::escape;
+
+            if (byte >= 0x30 && byte <= 0x7e)
+                return sequence_state::ground;
+
+            return sequence_state::escape_intermediate;
+
+        case sequence_state::control_sequence:
+            if (byte == esc)
+                return sequence_state::escape;
+
+            if (byte >= 0x40 && byte <= 0x7e)
+                return sequence_state::ground;
+
+            return sequence_state::control_sequence;
+
+        case sequence_state::control_string:
+            if (byte == bel)
+                return sequence_state::ground;
+
+            if (byte == esc)
+                return sequence_state::control_string_escape;
+
+            return sequence_state::control_string;
+
+        case sequence_state::control_string_escape:
+            if (byte == '\\')
+                return sequence_state::ground;
+
+            if (byte == esc)
+                return sequence_state::escape;
+
+            return after_escape(byte);
+    }
+
+    return sequence_state::ground;
+}
+
+void tracking_decoder::track_sequence(sequence_state const previous, unsigned char const byte)
+{
+    if (state == sequence_state::control_sequence) {
+        if (previous != sequence_state::control_sequence) {
+            sequence_size = 0;
+        } else if (byte >= 0x20) {
+            // C0 controls are executed in the middle of a sequence, they're
+            // not part of it.
+            if (sequence_size < max_sequence_size)
+                sequence[sequence_size] = static_cast<char>(byte);
+
+            ++sequence_size;
+        }
+
+        return;
+    }
+
+    if (previous == sequence_state::control_sequence && state == sequence_state::ground
+        && byte >= 0x40)
+    {
+        apply_control_sequence(byte);
+        return;
+    }
+
+    // RIS
+    if (previous == sequence_state::escape && byte == 'c')
+        style = cursor_style{};
+}
+
+void tracking_decoder::apply_control_sequence(unsigned char const final_byte)
+{
+    if (sequence_size > max_sequence_size)
+        return;
+
+    char const* const begin = sequence;
+    char const* const end = sequence + sequence_size;
+
+    switch (final_byte) {
+        case 'h':
+        case 'l': {
+            if (begin == end || *begin != '?')
+                return;
+
+            auto const set = final_byte == 'h';
+
+            for (auto it = begin + 1;; ++it) {
+                int mode;
+                it = parse_parameter(it, end, mode);
+                if (it != end && *it != ';')
+                    return;
+
+                if (mode == 25)
+                    style.visible = set;
+                else if (mode == 12)
+                    style.blinking = set;
+
+                if (it == end)
+                    break;
+            }
+
+            return;
+        }
+
+        case 'q': {
+            // DECSCUSR has a space intermediate, without one it's a
+            // different sequence.
+            if (begin == end || *(end - 1) != ' ')
+                return;
+
+            int parameter;
+            if (parse_parameter(begin, end, parameter) != end - 1 || parameter > 6)
+                return;
+
+            // 0 and 1 are a blinking block, after that each shape comes as a
+            // blinking and a steady variant.
+            auto const shape_index = parameter == 0 ? 0 : (parameter - 1) / 2;
+            style.shape = static_cast<cursor_shape>(shape_index);
+            style.blinking = parameter == 0 || parameter % 2 == 1;
+            return;
+        }
+
+        case 'p':
+            // DECSTR
+            if (sequence_size == 1 && *begin == '!')
+                style.visible = true;
+
+            return;
+    }
+}
+
+void tracking_decoder::decode(
+        char const* const bytes,
+        std::size_t const count,
+        katerm::terminal_instructee& t)
+{
+    for (std::size_t pos = 0; pos != count; ++pos) {
+        auto const byte = static_cast<unsigned char>(bytes[pos]);
+        auto const previous = state;
+        state = next_state(state, byte);
+        track_sequence(previous, byte);
+    }
+
+    decoder.decode(bytes, count, t);
+}
+
+} // gd100::
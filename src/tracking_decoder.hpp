@@ -0,0 +1,53 @@
+#ifndef GDTERM_TRACKING_DECODER_HPP
+#define GDTERM_TRACKING_DECODER_HPP
+
+#include <cstddef>
+
+#include <katerm/terminal.hpp>
+
+#include "cursor_style.hpp"
+
+namespace gd100 {
+
+// Wraps katerm::decoder to pick the cursor shape, blinking and visibility out
+// of the control sequences, katerm doesn't keep those.  Every byte is
+// interpreted by katerm, this class only follows where sequences begin and
+// end, so if it misreads one only the cursor style can be wrong.
+class tracking_decoder {
+public:
+    void decode(char const* bytes, std::size_t count, katerm::terminal_instructee& t);
+
+    cursor_style const& cursor() const noexcept { return style; }
+
+private:
+    enum class sequence_state {
+        ground,
+        ground_c2,           // Saw 0xC2, which starts the UTF-8 encoding of C1 controls
+        escape,
+        escape_intermediate,
+        control_sequence,
+        control_string,      // OSC, DCS, APC, PM and SOS
+        control_string_escape,
+    };
+
+    static sequence_state next_state(sequence_state state, unsigned char byte);
+    static sequence_state after_escape(unsigned char byte);
+
+    void track_sequence(sequence_state previous, unsigned char byte);
+    void apply_control_sequence(unsigned char final_byte);
+
+    katerm::decoder decoder;
+    sequence_state state = sequence_state::ground;
+
+    // Parameter and intermediate bytes of the current control sequence.  The
+    // ones we're interested in are short, longer ones are ignored.
+    static constexpr std::size_t max_sequence_size = 16;
+    char sequence[max_sequence_size];
+    std::size_t sequence_size = 0;
+
+    cursor_style style;
+};
+
+} // gd100::
+
+#endif // header guard
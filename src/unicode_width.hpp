@@ -0,0 +1,16 @@
+#ifndef GDTERM_UNICODE_WIDTH_HPP
+#define GDTERM_UNICODE_WIDTH_HPP
+
+namespace gd100 {
+
+// Number of columns a printable code point takes up: 0 for combining marks
+// and other zero width characters, 2 for East Asian wide and fullwidth
+// characters and emoji presentation, 1 for everything else.
+//
+// Backed by a two stage table that's generated at compile time from the
+// ranges in unicode_width.cpp, so a lookup is two loads.
+int code_point_width(char32_t code) noexcept;
+
+} // gd100::
+
+#endif // header guard
@@ -0,0 +1,37 @@
+#ifndef GDTERM_TESTS_CHECK_HPP
+#define GDTERM_TESTS_CHECK_HPP
+
+#include <cstdio>
+#include <cstdlib>
+
+// Just enough to write the checks run by ctest without a test framework.
+// Failed checks are printed and counted, main returns finish().
+
+namespace gd100::test {
+
+inline int failures = 0;
+
+inline void check(bool const ok, char const* const expression, char const* const file, int const line)
+{
+    if (ok)
+        return;
+
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+    ++failures;
+}
+
+inline int finish()
+{
+    if (failures == 0)
+        return EXIT_SUCCESS;
+
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+    return EXIT_FAILURE;
+}
+
+} // gd100::test::
+
+#define CHECK(expression) \
+    ::gd100::test::check(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+
+#endif // header guard
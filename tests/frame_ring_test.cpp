@@ -0,0 +1,130 @@
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "check.hpp"
+#include "frame_ring.hpp"
+
+namespace {
+
+struct record {
+    gd100::frame_ring::record_kind kind;
+    std::string data;
+};
+
+std::vector<record> drain(gd100::frame_ring& ring)
+{
+    std::vector<record> ret;
+    ring.drain([&](auto const kind, void const* const data, std::size_t const size) {
+        ret.push_back({kind, std::string(static_cast<char const*>(data), size)});
+    });
+    return ret;
+}
+
+bool push(gd100::frame_ring& ring, gd100::frame_ring::record_kind const kind, std::string const& data)
+{
+    return ring.push(kind, data.data(), data.size());
+}
+
+void records_in_order()
+{
+    auto ring = gd100::frame_ring::create(256);
+
+    CHECK(drain(ring).empty());
+
+    CHECK(push(ring, 1, "first"));
+    CHECK(push(ring, 2, ""));
+    CHECK(push(ring, 3, "third"));
+
+    auto const records = drain(ring);
+    CHECK(records.size() == 3);
+    if (records.size() != 3)
+        return;
+
+    CHECK(records[0].kind == 1 && records[0].data == "first");
+    CHECK(records[1].kind == 2 && records[1].data.empty());
+    CHECK(records[2].kind == 3 && records[2].data == "third");
+
+    CHECK(drain(ring).empty());
+}
+
+void full_ring()
+{
+    auto ring = gd100::frame_ring::create(64);
+
+    // Each record takes its 8 byte header plus the data.
+    std::string const data(24, 'x');
+    CHECK(push(ring, 1, data));
+    CHECK(push(ring, 1, data));
+    CHECK(!push(ring, 1, data));
+
+    // Larger than the whole ring.
+    CHECK(!push(ring, 1, std::string(100, 'y')));
+
+    // Draining frees the room again.
+    CHECK(drain(ring).size() == 2);
+    CHECK(push(ring, 1, data));
+}
+
+void wrap_around()
+{
+    auto ring = gd100::frame_ring::create(128);
+
+    // Records of different sizes so they end at different offsets, which
+    // sooner or later needs a padding record at the end of the buffer.
+    // Padding never shows up when draining.  Records stay below half the
+    // capacity so they always fit in an empty ring, padding included.
+    for (int i = 0; i != 100; ++i) {
+        auto const data = std::string(static_cast<std::size_t>(i % 5 * 7), static_cast<char>('a' + i % 26));
+        CHECK(push(ring, static_cast<gd100::frame_ring::record_kind>(i + 1), data));
+
+        auto const records = drain(ring);
+        CHECK(records.size() == 1);
+        if (records.size() == 1) {
+            CHECK(records[0].kind == static_cast<gd100::frame_ring::record_kind>(i + 1));
+            CHECK(records[0].data == data);
+        }
+    }
+}
+
+void attach()
+{
+    auto producer = gd100::frame_ring::create(128);
+    auto consumer = gd100::frame_ring::attach(dup(producer.memory_descriptor()));
+
+    CHECK(push(producer, 5, "shared"));
+
+    auto const records = drain(consumer);
+    CHECK(records.size() == 1);
+    CHECK(!records.empty() && records[0].kind == 5 && records[0].data == "shared");
+
+    // The producer sees when the consumer made room.  Together with the
+    // padding at the end of the buffer the second record doesn't fit until
+    // the first one is consumed.
+    std::string const data(56, 'z');
+    CHECK(push(producer, 6, data));
+    CHECK(!push(producer, 6, data));
+    CHECK(drain(consumer).size() == 1);
+    CHECK(push(producer, 6, data));
+    CHECK(drain(consumer).size() == 1);
+
+    // Moving a ring keeps the mapping.
+    auto moved = std::move(consumer);
+    CHECK(push(producer, 7, "moved"));
+    CHECK(drain(moved).size() == 1);
+}
+
+} // ::
+
+int main()
+{
+    records_in_order();
+    full_ring();
+    wrap_around();
+    attach();
+
+    return gd100::test::finish();
+}
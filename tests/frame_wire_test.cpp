@@ -0,0 +1,149 @@
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "check.hpp"
+#include "frame_wire.hpp"
+
+namespace {
+
+gd100::frame full_frame()
+{
+    gd100::frame f;
+    f.width = 2;
+    f.shift = gd100::region_shift{1, 5, -2};
+    f.rows = {0, 3};
+    f.cells = {
+        0x112233ff, 0x000000ff, 'a' | gd100::cell_fg_indexed,
+        7, 0, 'b' | gd100::cell_bg_indexed,
+        0x445566ff, 0x778899ff, 0x4e00 | gd100::cell_wide,
+        0x445566ff, 0x778899ff, gd100::cell_wide_continuation,
+    };
+    f.cursor = gd100::cursor_state{{1, 3}, {gd100::cursor_shape::bar, false, true}};
+    f.scroll_change = -4;
+    f.mouse = katerm::mouse_mode::motion;
+    f.sgr_mouse = true;
+
+    auto img = std::make_shared<gd100::image>();
+    img->id = 42;
+    img->width = 1;
+    img->height = 2;
+    img->data = {1, 2, 3, 4, 5, 6, 7, 8};
+
+    f.images.push_back({42, 3, 4, img});
+    f.images.push_back({42, 5, 6, nullptr});
+    f.deleted_images = {9, 0};
+
+    return f;
+}
+
+void frame_round_trip()
+{
+    auto const sent = full_frame();
+
+    std::vector<char> bytes;
+    gd100::write_frame(sent, bytes);
+
+    gd100::frame received;
+    CHECK(gd100::read_frame(bytes.data(), bytes.size(), received));
+
+    CHECK(received.width == sent.width);
+    CHECK(received.shift.has_value());
+    if (received.shift) {
+        CHECK(received.shift->top == 1);
+        CHECK(received.shift->bottom == 5);
+        CHECK(received.shift->delta == -2);
+    }
+
+    CHECK(received.rows == sent.rows);
+    CHECK(received.cells == sent.cells);
+    CHECK(received.cursor == sent.cursor);
+    CHECK(received.scroll_change == -4);
+    CHECK(received.mouse == katerm::mouse_mode::motion);
+    CHECK(received.sgr_mouse);
+    CHECK(received.deleted_images == sent.deleted_images);
+
+    CHECK(received.images.size() == 2);
+    if (received.images.size() == 2) {
+        auto const& first = received.images[0];
+        CHECK(first.id == 42 && first.column == 3 && first.row == 4);
+        CHECK(first.data != nullptr);
+        if (first.data) {
+            CHECK(first.data->id == 42);
+            CHECK(first.data->format == gd100::image_format::rgba);
+            CHECK(first.data->width == 1 && first.data->height == 2);
+            CHECK(first.data->data == sent.images[0].data->data);
+        }
+
+        auto const& second = received.images[1];
+        CHECK(second.id == 42 && second.column == 5 && second.row == 6);
+        CHECK(second.data == nullptr);
+    }
+}
+
+void empty_frame_round_trip()
+{
+    std::vector<char> bytes;
+    gd100::write_frame(gd100::frame{}, bytes);
+
+    // Whatever was in the frame before is replaced.
+    auto received = full_frame();
+    CHECK(gd100::read_frame(bytes.data(), bytes.size(), received));
+
+    CHECK(received.width == 0);
+    CHECK(!received.shift);
+    CHECK(received.rows.empty());
+    CHECK(received.cells.empty());
+    CHECK(!received.cursor);
+    CHECK(received.scroll_change == 0);
+    CHECK(received.mouse == katerm::mouse_mode::none);
+    CHECK(!received.sgr_mouse);
+    CHECK(received.images.empty());
+    CHECK(received.deleted_images.empty());
+}
+
+void truncated_frame()
+{
+    std::vector<char> bytes;
+    gd100::write_frame(full_frame(), bytes);
+
+    for (std::size_t size = 0; size != bytes.size(); ++size) {
+        gd100::frame received;
+        CHECK(!gd100::read_frame(bytes.data(), size, received));
+    }
+}
+
+void exit_round_trip()
+{
+    gd100::process_exit const sent{
+        128 + 9,
+        std::chrono::microseconds{1'234'567},
+        std::chrono::microseconds{89},
+        123'456,
+    };
+
+    std::vector<char> bytes;
+    gd100::write_exit(sent, bytes);
+
+    gd100::process_exit received{};
+    CHECK(gd100::read_exit(bytes.data(), bytes.size(), received));
+    CHECK(received.code == sent.code);
+    CHECK(received.user_time == sent.user_time);
+    CHECK(received.system_time == sent.system_time);
+    CHECK(received.max_rss == sent.max_rss);
+
+    CHECK(!gd100::read_exit(bytes.data(), bytes.size() - 1, received));
+}
+
+} // ::
+
+int main()
+{
+    frame_round_trip();
+    empty_frame_round_trip();
+    truncated_frame();
+    exit_round_trip();
+
+    return gd100::test::finish();
+}
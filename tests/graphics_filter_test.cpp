@@ -0,0 +1,258 @@
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <katerm/terminal.hpp>
+
+#include "check.hpp"
+#include "graphics_filter.hpp"
+
+namespace {
+
+constexpr auto terminal_size = katerm::extend{80, 24};
+
+// A terminal with its filter, fed a string at a time.
+struct filtered_terminal {
+    katerm::terminal terminal{terminal_size};
+    gd100::tracking_decoder decoder;
+    gd100::graphics_filter graphics;
+
+    void feed(std::string_view const bytes)
+    {
+        graphics.feed(bytes.data(), bytes.size(), terminal, decoder);
+    }
+
+    gd100::frame updates()
+    {
+        gd100::frame ret;
+        graphics.take_updates(ret);
+        return ret;
+    }
+};
+
+std::uint32_t pixel_at(gd100::image const& img, int const x, int const y)
+{
+    unsigned char bytes[4];
+    std::memcpy(bytes, img.data.data() + (static_cast<std::size_t>(y) * img.width + x) * 4, 4);
+    return std::uint32_t{bytes[0]} << 24 | std::uint32_t{bytes[1]} << 16
+         | std::uint32_t{bytes[2]} << 8 | bytes[3];
+}
+
+void sixel_image()
+{
+    filtered_terminal t;
+
+    // A red column, then a green one three pixels high on the background.
+    t.feed("\x1bPq\"1;1;2;6#1;2;100;0;0#1~#2;2;0;100;0$?F\x1b\\");
+
+    auto const frame = t.updates();
+    CHECK(frame.images.size() == 1);
+    if (frame.images.empty())
+        return;
+
+    auto const& placement = frame.images[0];
+    CHECK(placement.column == 0);
+    CHECK(placement.row == 0);
+    CHECK(placement.data != nullptr);
+    if (!placement.data)
+        return;
+
+    auto const& img = *placement.data;
+    CHECK(img.format == gd100::image_format::rgba);
+    CHECK(img.width == 2);
+    CHECK(img.height == 6);
+    CHECK(pixel_at(img, 0, 0) == 0xff0000ff);
+    CHECK(pixel_at(img, 0, 5) == 0xff0000ff);
+    CHECK(pixel_at(img, 1, 2) == 0x00ff00ff);
+    CHECK(pixel_at(img, 1, 3) == 0x000000ff); // Background, register 0
+
+    // Six pixels are less than a cell, the cursor goes to the row below.
+    CHECK(t.terminal.cursor.pos.x == 0);
+    CHECK(t.terminal.cursor.pos.y == 1);
+}
+
+void sixel_transparent_background()
+{
+    filtered_terminal t;
+    t.feed("\x1bP0;1q\"1;1;2;6#1;2;100;0;0#1~\x1b\\");
+
+    auto const frame = t.updates();
+    CHECK(frame.images.size() == 1);
+    if (frame.images.empty() || !frame.images[0].data)
+        return;
+
+    CHECK(pixel_at(*frame.images[0].data, 1, 0) == 0);
+}
+
+void long_dcs_header()
+{
+    // Parameters past what's stored are skipped, the q still ends the header.
+    filtered_terminal t;
+    t.feed("\x1bP" + std::string(100, '0') + "q#1~\x1b\\");
+    CHECK(t.updates().images.size() == 1);
+
+    // An intermediate byte past the stored part still makes it something
+    // other than sixel.
+    filtered_terminal u;
+    u.feed("\x1bP" + std::string(100, '1') + "$q#1~\x1b\\");
+    CHECK(u.updates().images.empty());
+
+    // Parameter bytes in 0x3c-0x3f don't end the header either.
+    filtered_terminal v;
+    v.feed("\x1bP" + std::string(100, '?') + "q#1~\x1b\\");
+    CHECK(v.updates().images.size() == 1);
+}
+
+void cancelled_dcs_header()
+{
+    filtered_terminal t;
+    t.feed("\x1bP1;2\x18q#1~\x1b\\");
+    CHECK(t.updates().images.empty());
+}
+
+void kitty_transmit_and_display()
+{
+    filtered_terminal t;
+
+    // Two RGB pixels, red and green.
+    t.feed("\x1b_Ga=T,f=24,s=2,v=1,i=7;/wAAAP8A\x1b\\");
+
+    auto const frame = t.updates();
+    CHECK(frame.images.size() == 1);
+    if (frame.images.empty() || !frame.images[0].data)
+        return;
+
+    auto const& img = *frame.images[0].data;
+    CHECK(frame.images[0].id == 7);
+    CHECK(img.width == 2);
+    CHECK(img.height == 1);
+    CHECK(img.data.size() == 8);
+    CHECK(pixel_at(img, 0, 0) == 0xff0000ff);
+    CHECK(pixel_at(img, 1, 0) == 0x00ff00ff);
+
+    CHECK(t.graphics.take_responses() == "\x1b_Gi=7;OK\x1b\\");
+
+    // The cursor ends up after the image on its last row.
+    CHECK(t.terminal.cursor.pos.x == 1);
+    CHECK(t.terminal.cursor.pos.y == 0);
+}
+
+void kitty_chunks()
+{
+    filtered_terminal t;
+    t.feed("\x1b_Ga=T,f=24,s=2,v=1,i=8,m=1;/wAA\x1b\\");
+    CHECK(t.updates().images.empty());
+
+    t.feed("\x1b_Gm=0;AP8A\x1b\\");
+    auto const frame = t.updates();
+    CHECK(frame.images.size() == 1);
+    if (!frame.images.empty() && frame.images[0].data)
+        CHECK(pixel_at(*frame.images[0].data, 1, 0) == 0x00ff00ff);
+}
+
+void kitty_size_mismatch()
+{
+    filtered_terminal t;
+    t.feed("\x1b_Ga=T,f=24,s=2,v=2,i=9;/wAAAP8A\x1b\\");
+
+    CHECK(t.updates().images.empty());
+    CHECK(t.graphics.take_responses()
+          == "\x1b_Gi=9;EINVAL:image data doesn't match its size\x1b\\");
+}
+
+void kitty_place_and_delete()
+{
+    filtered_terminal t;
+
+    // Transmitted without being shown.
+    t.feed("\x1b_Ga=t,f=24,s=2,v=1,i=3,q=1;/wAAAP8A\x1b\\");
+    CHECK(t.updates().images.empty());
+    CHECK(t.graphics.take_responses().empty());
+
+    // The first placement carries the pixels, later ones don't.
+    t.feed("\x1b_Ga=p,i=3,q=1\x1b\\");
+    t.feed("\x1b_Ga=p,i=3,q=1\x1b\\");
+    auto const placed = t.updates();
+    CHECK(placed.images.size() == 2);
+    if (placed.images.size() == 2) {
+        CHECK(placed.images[0].data != nullptr);
+        CHECK(placed.images[1].data == nullptr);
+    }
+
+    // Upper case frees the image, placing it fails afterwards.
+    t.feed("\x1b_Ga=d,d=I,i=3\x1b\\");
+    auto const deleted = t.updates();
+    CHECK(deleted.deleted_images.size() == 1);
+    CHECK(!deleted.deleted_images.empty() && deleted.deleted_images[0] == 3);
+
+    t.feed("\x1b_Ga=p,i=3\x1b\\");
+    CHECK(t.updates().images.empty());
+    CHECK(t.graphics.take_responses() == "\x1b_Gi=3;ENOENT:no such image\x1b\\");
+}
+
+std::shared_ptr<gd100::image const> make_image(std::uint32_t const id, std::size_t const bytes)
+{
+    auto ret = std::make_shared<gd100::image>();
+    ret->id = id;
+    ret->data.resize(bytes);
+    return ret;
+}
+
+void cache_eviction()
+{
+    constexpr std::size_t image_bytes = 1000;
+
+    // Room for two images with their bookkeeping, not three.
+    gd100::image_cache cache{2 * (sizeof(gd100::image) + image_bytes)};
+    std::vector<std::uint32_t> evicted;
+
+    cache.insert(make_image(1, image_bytes), evicted);
+    cache.insert(make_image(2, image_bytes), evicted);
+    CHECK(evicted.empty());
+
+    // Looking 1 up makes 2 the least recently used one.
+    CHECK(cache.find(1) != nullptr);
+    cache.insert(make_image(3, image_bytes), evicted);
+    CHECK(evicted.size() == 1 && evicted[0] == 2);
+    CHECK(cache.find(2) == nullptr);
+    CHECK(cache.find(1) != nullptr);
+    CHECK(cache.find(3) != nullptr);
+
+    // Replacing an image doesn't count it twice.
+    evicted.clear();
+    cache.insert(make_image(3, image_bytes), evicted);
+    CHECK(evicted.empty());
+
+    // The newest image stays even when it's over the limit by itself.
+    cache.insert(make_image(4, 10 * image_bytes), evicted);
+    CHECK(evicted.size() == 2);
+    CHECK(cache.find(4) != nullptr);
+    CHECK(cache.find(1) == nullptr);
+
+    // Erased images free their room.
+    cache.erase(4);
+    evicted.clear();
+    cache.insert(make_image(5, image_bytes), evicted);
+    cache.insert(make_image(6, image_bytes), evicted);
+    CHECK(evicted.empty());
+}
+
+} // ::
+
+int main()
+{
+    sixel_image();
+    sixel_transparent_background();
+    long_dcs_header();
+    cancelled_dcs_header();
+    kitty_transmit_and_display();
+    kitty_chunks();
+    kitty_size_mismatch();
+    kitty_place_and_delete();
+    cache_eviction();
+
+    return gd100::test::finish();
+}
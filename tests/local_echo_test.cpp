@@ -0,0 +1,242 @@
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "check.hpp"
+#include "local_echo.hpp"
+
+namespace {
+
+using namespace std::chrono_literals;
+
+constexpr int width = 10;
+constexpr int height = 2;
+
+// What the program has put on screen so far.  -1 stands for a cell that isn't
+// known.
+struct screen {
+    long cells[height][width];
+    katerm::position cursor{0, 0};
+
+    screen()
+    {
+        for (auto& row : cells) {
+            for (auto& cell : row)
+                cell = ' ';
+        }
+    }
+
+    void echo(std::string_view const text)
+    {
+        for (auto const c : text)
+            cells[cursor.y][cursor.x++] = c;
+    }
+
+    auto lookup() const
+    {
+        return [this](int const column, int const row) -> long {
+            if (column < 0 || column >= width || row < 0 || row >= height)
+                return -1;
+            return cells[row][column];
+        };
+    }
+};
+
+struct predictor {
+    gd100::local_echo echo;
+    screen program;
+    gd100::local_echo::clock::time_point now{};
+
+    bool type(katerm::code_point const code)
+    {
+        return echo.typed(code, program.cursor, width, program.lookup(), now);
+    }
+
+    bool reconcile()
+    {
+        return echo.reconcile(program.cursor, program.lookup(), now);
+    }
+
+    // The overlay as characters, for comparisons.
+    std::vector<std::int32_t> shown() const
+    {
+        std::vector<std::int32_t> ret;
+        auto const& overlay = echo.overlay();
+        for (std::size_t i = 2; i < overlay.size(); i += 3)
+            ret.push_back(overlay[i]);
+        return ret;
+    }
+};
+
+void disabled()
+{
+    predictor p;
+    CHECK(!p.type('a'));
+    CHECK(p.echo.overlay().empty());
+    CHECK(p.echo.deadline() == gd100::local_echo::clock::time_point::max());
+}
+
+void shown_after_first_echo()
+{
+    predictor p;
+    p.echo.set_enabled(true);
+    p.program.echo("$ ");
+
+    // Nothing is shown before the program echoed something of this epoch.
+    CHECK(!p.type('a'));
+    CHECK(!p.type('b'));
+    CHECK(p.echo.overlay().empty());
+
+    p.program.echo("a");
+    CHECK(p.reconcile());
+    CHECK(p.echo.overlay() == (std::vector<std::int32_t>{3, 0, 'b'}));
+
+    CHECK(p.type('c'));
+    CHECK(p.shown() == (std::vector<std::int32_t>{'b', 'c'}));
+
+    p.program.echo("bc");
+    CHECK(p.reconcile());
+    CHECK(p.echo.overlay().empty());
+    CHECK(p.echo.deadline() == gd100::local_echo::clock::time_point::max());
+
+    // Still confirmed, the next one shows right away.
+    CHECK(p.type('d'));
+    CHECK(p.echo.overlay() == (std::vector<std::int32_t>{5, 0, 'd'}));
+}
+
+void wrong_guess()
+{
+    predictor p;
+    p.echo.set_enabled(true);
+
+    p.type('a');
+    p.type('b');
+    p.program.echo("a");
+    p.reconcile();
+    CHECK(p.shown() == (std::vector<std::int32_t>{'b'}));
+
+    // The program echoed something else, everything goes and the next
+    // epoch has to be confirmed again.
+    p.program.echo("*");
+    CHECK(p.reconcile());
+    CHECK(p.echo.overlay().empty());
+
+    CHECK(!p.type('c'));
+    CHECK(p.echo.overlay().empty());
+}
+
+void new_epoch_keys()
+{
+    predictor p;
+    p.echo.set_enabled(true);
+
+    p.type('a');
+    p.type('b');
+    p.program.echo("a");
+    p.reconcile();
+    CHECK(!p.echo.overlay().empty());
+
+    // Enter starts a new epoch.
+    CHECK(p.type('\r'));
+    CHECK(p.echo.overlay().empty());
+    CHECK(!p.type('x'));
+
+    // Wide characters aren't guessed either.
+    CHECK(!p.type(0x4e00));
+    CHECK(p.echo.deadline() == gd100::local_echo::clock::time_point::max());
+}
+
+void end_of_row()
+{
+    predictor p;
+    p.echo.set_enabled(true);
+    p.program.echo("$ ");
+
+    p.type('a');
+    p.program.echo("a");
+    p.reconcile();
+
+    // Where the row wraps is up to the program.
+    for (int i = 0; i != width - 3; ++i)
+        p.type('b');
+    CHECK(p.shown().size() == static_cast<std::size_t>(width - 3));
+
+    CHECK(p.type('c'));
+    CHECK(p.echo.overlay().empty());
+}
+
+void timeout()
+{
+    predictor p;
+    p.echo.set_enabled(true);
+
+    p.type('a');
+    p.type('b');
+    p.program.echo("a");
+    p.reconcile();
+
+    CHECK(p.echo.deadline() == p.now + gd100::local_echo::echo_timeout);
+    CHECK(!p.echo.expire(p.now + 500ms));
+    CHECK(p.echo.expire(p.now + gd100::local_echo::echo_timeout));
+    CHECK(p.echo.overlay().empty());
+}
+
+void cell_already_held_character()
+{
+    predictor p;
+    p.echo.set_enabled(true);
+
+    // Editing a line that already reads "ab", with the cursor at its start.
+    p.program.echo("ab");
+    p.program.cursor.x = 0;
+    p.type('x');
+    p.program.echo("x");
+    p.reconcile();
+
+    p.type('b');
+    p.type('c');
+    CHECK(p.shown() == (std::vector<std::int32_t>{'b', 'c'}));
+
+    // The b on screen is from before, it confirms nothing yet.
+    CHECK(!p.reconcile());
+    CHECK(p.shown() == (std::vector<std::int32_t>{'b', 'c'}));
+
+    // Once the cursor moved past it, it was echoed.
+    p.program.echo("b");
+    CHECK(p.reconcile());
+    CHECK(p.shown() == (std::vector<std::int32_t>{'c'}));
+}
+
+void unknown_cells()
+{
+    predictor p;
+    p.echo.set_enabled(true);
+
+    p.type('a');
+    p.type('b');
+    p.program.echo("a");
+    p.reconcile();
+
+    // While the cell isn't known the guess is neither echoed nor wrong, not
+    // even when the cursor went past it.
+    p.program.cells[0][1] = -1;
+    p.program.cursor = {0, 1};
+    CHECK(!p.reconcile());
+    CHECK(p.shown() == (std::vector<std::int32_t>{'b'}));
+}
+
+} // ::
+
+int main()
+{
+    disabled();
+    shown_after_first_echo();
+    wrong_guess();
+    new_epoch_keys();
+    end_of_row();
+    timeout();
+    cell_already_held_character();
+    unknown_cells();
+
+    return gd100::test::finish();
+}
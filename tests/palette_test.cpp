@@ -0,0 +1,52 @@
+#include "check.hpp"
+#include "palette.hpp"
+
+namespace {
+
+void default_palette()
+{
+    auto const& p = gd100::default_palette;
+
+    CHECK(p[0] == 0x000000ff);
+    CHECK(p[1] == 0xcd0000ff);
+    CHECK(p[15] == 0xffffffff);
+
+    // The colour cube, 16 + 36 r + 6 g + b.
+    CHECK(p[16] == 0x000000ff);
+    CHECK(p[16 + 36 * 5] == 0xff0000ff);
+    CHECK(p[16 + 6 * 1 + 2] == 0x005f87ff);
+    CHECK(p[231] == 0xffffffff);
+
+    // The grey ramp.
+    CHECK(p[232] == 0x080808ff);
+    CHECK(p[255] == 0xeeeeeeff);
+}
+
+void system_colour_indices()
+{
+    for (int i = 0; i != gd100::ansi_colour_count; ++i)
+        CHECK(gd100::ansi_palette_index(gd100::default_palette[i]) == i);
+
+    // Cube and ramp colours stay plain colours.
+    CHECK(gd100::ansi_palette_index(gd100::default_palette[16 + 36 * 2 + 6 * 3 + 4]) == -1);
+    CHECK(gd100::ansi_palette_index(gd100::default_palette[244]) == -1);
+    CHECK(gd100::ansi_palette_index(0x123456ff) == -1);
+
+    // Black and white are in the cube too, they're taken to be the system
+    // colours.
+    CHECK(gd100::ansi_palette_index(gd100::default_palette[16]) == 0);
+    CHECK(gd100::ansi_palette_index(gd100::default_palette[231]) == 15);
+
+    // A different alpha is a different colour.
+    CHECK(gd100::ansi_palette_index(0xcd000080) == -1);
+}
+
+} // ::
+
+int main()
+{
+    default_palette();
+    system_colour_indices();
+
+    return gd100::test::finish();
+}
@@ -0,0 +1,105 @@
+#include <string>
+#include <string_view>
+
+#include <katerm/terminal.hpp>
+
+#include "check.hpp"
+#include "text_extraction.hpp"
+#include "tracking_decoder.hpp"
+
+namespace {
+
+// A 10x4 terminal with the given output on it.
+struct written_terminal {
+    katerm::terminal terminal{katerm::extend{10, 4}};
+
+    explicit written_terminal(std::string_view const output)
+    {
+        gd100::tracking_decoder decoder;
+        katerm::terminal_instructee instructee{&terminal};
+        decoder.decode(output.data(), output.size(), instructee);
+    }
+
+    std::string text(katerm::position const start, katerm::position const end, int const options) const
+    {
+        return gd100::extract_text(terminal, start, end, options);
+    }
+};
+
+std::string utf8(char32_t const code)
+{
+    std::string ret;
+    gd100::append_utf8(ret, code);
+    return ret;
+}
+
+void utf8_encoding()
+{
+    CHECK(utf8('a') == "a");
+    CHECK(utf8(0) == " ");
+    CHECK(utf8(0xe9) == "\xc3\xa9");
+    CHECK(utf8(0x4e00) == "\xe4\xb8\x80");
+    CHECK(utf8(0x1f600) == "\xf0\x9f\x98\x80");
+
+    // Surrogates and values past the last code point.
+    CHECK(utf8(0xd800) == "\xef\xbf\xbd");
+    CHECK(utf8(0x110000) == "\xef\xbf\xbd");
+}
+
+void stream_selection()
+{
+    written_terminal const t{"first\r\nsecond\r\nthird"};
+
+    CHECK(t.text({2, 0}, {2, 1}, 0) == "rst     \nsec");
+    CHECK(t.text({2, 0}, {2, 1}, gd100::text_trim_trailing_spaces) == "rst\nsec");
+
+    // Either order, the same text.
+    CHECK(t.text({2, 1}, {2, 0}, gd100::text_trim_trailing_spaces) == "rst\nsec");
+
+    // Positions off the screen are clamped.
+    CHECK(t.text({-5, -5}, {100, 100}, gd100::text_trim_trailing_spaces) == "first\nsecond\nthird\n");
+}
+
+void rectangular_selection()
+{
+    written_terminal const t{"first\r\nsecond\r\nthird"};
+
+    CHECK(t.text({1, 0}, {3, 2}, gd100::text_rectangular) == "irs\neco\nhir");
+    CHECK(t.text({3, 2}, {1, 0}, gd100::text_rectangular) == "irs\neco\nhir");
+    CHECK(t.text({4, 0}, {6, 1}, gd100::text_rectangular | gd100::text_trim_trailing_spaces)
+          == "t\nnd");
+}
+
+void wrapped_lines()
+{
+    // Twelve characters on a ten column terminal wrap onto the next row.
+    written_terminal const t{"abcdefghijkl\r\nnext"};
+
+    auto const trim = gd100::text_trim_trailing_spaces;
+    CHECK(t.text({0, 0}, {9, 2}, trim) == "abcdefghij\nkl\nnext");
+    CHECK(t.text({0, 0}, {9, 2}, trim | gd100::text_join_wrapped_lines) == "abcdefghijkl\nnext");
+}
+
+void line_text()
+{
+    written_terminal const t{"one  \r\n\r\n   three"};
+
+    CHECK(gd100::extract_line_text(t.terminal, 0) == "one");
+    CHECK(gd100::extract_line_text(t.terminal, 1).empty());
+    CHECK(gd100::extract_line_text(t.terminal, 2) == "   three");
+    CHECK(gd100::extract_line_text(t.terminal, -1).empty());
+    CHECK(gd100::extract_line_text(t.terminal, 4).empty());
+}
+
+} // ::
+
+int main()
+{
+    utf8_encoding();
+    stream_selection();
+    rectangular_selection();
+    wrapped_lines();
+    line_text();
+
+    return gd100::test::finish();
+}
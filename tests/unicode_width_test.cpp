@@ -0,0 +1,63 @@
+#include "check.hpp"
+#include "unicode_width.hpp"
+
+namespace {
+
+void common_characters()
+{
+    CHECK(gd100::code_point_width(U'a') == 1);
+    CHECK(gd100::code_point_width(U'~') == 1);
+    CHECK(gd100::code_point_width(0xe9) == 1);
+    CHECK(gd100::code_point_width(0x3b1) == 1); // Greek alpha
+    CHECK(gd100::code_point_width(0x4e2d) == 2);
+    CHECK(gd100::code_point_width(0xac00) == 2); // Hangul syllable
+    CHECK(gd100::code_point_width(0x1f600) == 2);
+    CHECK(gd100::code_point_width(0x0301) == 0); // Combining acute accent
+    CHECK(gd100::code_point_width(0x200d) == 0); // Zero width joiner
+    CHECK(gd100::code_point_width(0xfe0f) == 0); // Emoji presentation selector
+}
+
+void range_edges()
+{
+    // Hangul leading jamo are wide, the medial ones right after them combine.
+    CHECK(gd100::code_point_width(0x10ff) == 1);
+    CHECK(gd100::code_point_width(0x1100) == 2);
+    CHECK(gd100::code_point_width(0x115f) == 2);
+    CHECK(gd100::code_point_width(0x1160) == 0);
+    CHECK(gd100::code_point_width(0x11ff) == 0);
+    CHECK(gd100::code_point_width(0x1200) == 1);
+
+    // Fullwidth forms end where the halfwidth ones begin.
+    CHECK(gd100::code_point_width(0xff00) == 1);
+    CHECK(gd100::code_point_width(0xff01) == 2);
+    CHECK(gd100::code_point_width(0xff60) == 2);
+    CHECK(gd100::code_point_width(0xff61) == 1);
+
+    // The ideographic planes, the last ones in the table.
+    CHECK(gd100::code_point_width(0x1ffff) == 1);
+    CHECK(gd100::code_point_width(0x20000) == 2);
+    CHECK(gd100::code_point_width(0x3fffd) == 2);
+    CHECK(gd100::code_point_width(0x3fffe) == 1);
+}
+
+void past_the_table()
+{
+    CHECK(gd100::code_point_width(0x40000) == 1);
+    CHECK(gd100::code_point_width(0xdffff) == 1);
+    CHECK(gd100::code_point_width(0xe0001) == 0); // Language tag
+    CHECK(gd100::code_point_width(0xe0100) == 0); // Variation selector 17
+    CHECK(gd100::code_point_width(0xe0fff) == 0);
+    CHECK(gd100::code_point_width(0xe1000) == 1);
+    CHECK(gd100::code_point_width(0x10ffff) == 1);
+}
+
+} // ::
+
+int main()
+{
+    common_characters();
+    range_edges();
+    past_the_table();
+
+    return gd100::test::finish();
+}